@@ -0,0 +1,75 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-3.0
+#
+# Startup time and footprint of one rund supervising N services of a config
+# file. Each service is `command = /bin/sleep 100000 <i>` with respawn. When
+# 2 descriptors per service do not fit the hard RLIMIT_NOFILE, the services
+# use exec-by-path, which drops the cached O_PATH descriptor of the target.
+#
+# Usage: config_bench.sh RUND [N]...   (default: 1000 10000)
+#
+# config load: until the foreground rund returns, it parses the file first
+# spawn all:   until all N targets run
+# RSS:         VmRSS of the supervisor once all targets run
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 RUND [N]..." >&2
+    exit 1
+fi
+
+rund=$(realpath "$1")
+shift
+[ $# -gt 0 ] || set -- 1000 10000
+
+dir=$(mktemp -d)
+pid=
+
+cleanup()
+{
+    [ -z "$pid" ] || kill "$pid" 2>/dev/null || true
+    rm -rf "$dir"
+}
+trap cleanup EXIT INT TERM
+
+now_ms()
+{
+    echo $(($(date +%s%N) / 1000000))
+}
+
+printf '%8s %12s %12s %14s %9s\n' services "config load" "spawn all" "supervisor RSS" "open fds"
+
+for n in "$@"; do
+    extra=
+    if [ $((2 * n + 64)) -gt "$(ulimit -Hn)" ]; then
+        extra="exec-by-path = yes"
+    fi
+
+    awk -v n="$n" -v extra="$extra" 'BEGIN {
+        for (i = 0; i < n; i++)
+            printf "[svc%d]\ncommand = /bin/sleep 100000 %d\nrespawn = yes\n%s\n\n", i, i, extra
+    }' >"$dir/rund.conf"
+
+    start=$(now_ms)
+    "$rund" -p "$dir/rund.pid" --config="$dir/rund.conf"
+    loaded=$(now_ms)
+    pid=$(cat "$dir/rund.pid")
+
+    while [ "$(pgrep -c -P "$pid" || true)" -lt "$n" ]; do
+        sleep 0.05
+    done
+    spawned=$(now_ms)
+
+    rss=$(awk '/^VmRSS/ { printf "%.1f MB", $2 / 1024 }' "/proc/$pid/status")
+    fds=$(ls "/proc/$pid/fd" | wc -l)
+
+    printf '%8d %9d ms %10.2f s %14s %9d\n' "$n" $((loaded - start)) \
+        "$(echo "$spawned $loaded" | awk '{ print ($1 - $2) / 1000 }')" "$rss" "$fds"
+
+    kill "$pid"
+    while kill -0 "$pid" 2>/dev/null; do
+        sleep 0.1
+    done
+    pid=
+done
@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file spawn_bench.c
+ * @brief Spawn latency of the fork, vfork and clone3 backends versus RSS
+ * @details Fills the given amounts of memory, then times spawning and
+ *          reaping /bin/true with each backend the way spawn.c does it.
+ *
+ *          Usage: spawn_bench [-n ITERATIONS] [MIB]...
+ *          (default: 200 iterations at 0, 256, 1024 and 4096 MiB)
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-16   Frank <uuidxx@163.com>          the first version
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+
+#define STACK_SIZE (256 * 1024)
+
+// First version of struct clone_args
+struct bench_clone_args
+{
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+};
+
+static char *const child_argv[] = {"/bin/true", NULL};
+static void *stack = NULL;
+
+static int child_main(void *arg)
+{
+    (void)arg;
+
+    execv(child_argv[0], child_argv);
+    _exit(127);
+}
+
+static pid_t spawn_fork(void)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        child_main(NULL);
+    }
+
+    return pid;
+}
+
+static pid_t spawn_vfork(void)
+{
+    return clone(child_main, (char *)stack + STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, NULL);
+}
+
+// Same trampoline as clone3_trampoline() in spawn.c
+static pid_t spawn_clone3(void)
+{
+    int pidfd = -1;
+    struct bench_clone_args args = {
+        .flags = CLONE_VM | CLONE_VFORK | CLONE_PIDFD,
+        .pidfd = (uint64_t)(uintptr_t)&pidfd,
+        .exit_signal = SIGCHLD,
+        .stack = (uint64_t)(uintptr_t)stack,
+        .stack_size = STACK_SIZE,
+    };
+    long ret;
+
+#if defined(__x86_64__)
+    register long rax __asm__("rax") = SYS_clone3;
+    register long rdi __asm__("rdi") = (long)&args;
+    register long rsi __asm__("rsi") = (long)sizeof(args);
+    register long r13 __asm__("r13") = (long)child_main;
+
+    __asm__ volatile("syscall\n\t"
+                     "test %%rax, %%rax\n\t"
+                     "jnz 1f\n\t"
+                     "xor %%ebp, %%ebp\n\t"
+                     "xor %%edi, %%edi\n\t"
+                     "call *%%r13\n\t"
+                     "ud2\n"
+                     "1:"
+                     : "+r"(rax)
+                     : "r"(rdi), "r"(rsi), "r"(r13)
+                     : "rcx", "r11", "memory");
+    ret = rax;
+#elif defined(__aarch64__)
+    register long x8 __asm__("x8") = SYS_clone3;
+    register long x0 __asm__("x0") = (long)&args;
+    register long x1 __asm__("x1") = (long)sizeof(args);
+    register long x20 __asm__("x20") = (long)child_main;
+
+    __asm__ volatile("svc #0\n\t"
+                     "cbnz x0, 1f\n\t"
+                     "mov x29, xzr\n\t"
+                     "mov x30, xzr\n\t"
+                     "mov x0, xzr\n\t"
+                     "blr x20\n\t"
+                     "brk #0\n"
+                     "1:"
+                     : "+r"(x0)
+                     : "r"(x8), "r"(x1), "r"(x20)
+                     : "memory");
+    ret = x0;
+#else
+    (void)args;
+    ret = -ENOSYS;
+#endif
+
+    if (ret < 0)
+    {
+        errno = -ret;
+        return -1;
+    }
+
+    close(pidfd);
+
+    return ret;
+}
+
+static const struct
+{
+    const char *name;
+    pid_t (*spawn)(void);
+} backends[] = {
+    {"fork", spawn_fork},
+    {"vfork", spawn_vfork},
+    {"clone3", spawn_clone3},
+};
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t default_sizes[] = {0, 256, 1024, 4096};
+    int iterations = 200;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        if (opt != 'n' || (iterations = atoi(optarg)) <= 0)
+        {
+            fprintf(stderr, "usage: %s [-n ITERATIONS] [MIB]...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    size_t size_cnt = optind < argc ? (size_t)(argc - optind) : sizeof(default_sizes) / sizeof(default_sizes[0]);
+    double *spawn_us = calloc(iterations, sizeof(double));
+
+    stack = mmap(NULL, STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (!spawn_us || stack == MAP_FAILED)
+    {
+        perror("failed to allocate");
+        return 1;
+    }
+
+    printf("%8s  %-7s %12s %12s %12s\n", "RSS MiB", "backend", "mean us", "p50 us", "p99 us");
+
+    for (size_t i = 0; i < size_cnt; i++)
+    {
+        size_t mib = optind < argc ? strtoul(argv[optind + i], NULL, 10) : default_sizes[i];
+        char *fill = NULL;
+
+        // touch every page so that fork() has page tables to copy
+        if (mib > 0)
+        {
+            fill = malloc(mib << 20);
+            if (!fill)
+            {
+                perror("failed to fill RSS");
+                return 1;
+            }
+
+            memset(fill, 1, mib << 20);
+        }
+
+        for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++)
+        {
+            double total = 0;
+
+            for (int n = 0; n < iterations; n++)
+            {
+                double start = now_us();
+                pid_t pid = backends[b].spawn();
+                if (pid < 0)
+                {
+                    fprintf(stderr, "failed to spawn with %s: %s\n", backends[b].name, strerror(errno));
+                    return 1;
+                }
+
+                // fork returns before the exec, the others once it is done
+                spawn_us[n] = now_us() - start;
+                total += spawn_us[n];
+
+                waitpid(pid, NULL, 0);
+            }
+
+            qsort(spawn_us, iterations, sizeof(double), compare_double);
+            printf("%8zu  %-7s %12.1f %12.1f %12.1f\n",
+                   mib,
+                   backends[b].name,
+                   total / iterations,
+                   spawn_us[iterations / 2],
+                   spawn_us[iterations * 99 / 100]);
+        }
+
+        free(fill);
+    }
+
+    free(spawn_us);
+    munmap(stack, STACK_SIZE);
+
+    return 0;
+}
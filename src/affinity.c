@@ -0,0 +1,663 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file affinity.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-16   Frank <uuidxx@163.com>          the first version
+ * 2026-10-16   Frank <uuidxx@163.com>          add CPU load rebalancing
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+// Root of the CPU and NUMA topology in sysfs
+#define SYSFS_SYSTEM_DIR "/sys/devices/system"
+
+#define CPU_MASK_WORD_BITS (8 * sizeof(unsigned long))
+
+// A NUMA node and its cores, which are contiguous in the core table
+typedef struct
+{
+    // -1 on kernels without NUMA support, the node then holds every CPU
+    int id;
+    cpu_mask_t cpus;
+    int first_core;
+    int core_cnt;
+} numa_node_t;
+
+// Topology of the CPUs rund may run on, loaded on first use
+static bool topology_loaded = false;
+static cpu_mask_t allowed_cpus;
+static numa_node_t *nodes = NULL;
+static int node_cnt = 0;
+static cpu_mask_t *cores = NULL;
+static int core_cnt = 0;
+
+// Next slot of the spreading, shared by all services so that they do not
+// all start on the first core
+static int next_spread_slot = 0;
+
+/**
+ * @brief Add a CPU or node to a mask
+ *
+ * @param mask mask
+ * @param id CPU or node, less than CPU_MASK_BITS
+ */
+void cpu_mask_set(cpu_mask_t *mask, int id)
+{
+    mask->bits[id / CPU_MASK_WORD_BITS] |= 1UL << (id % CPU_MASK_WORD_BITS);
+}
+
+/**
+ * @brief Check whether a mask holds a CPU or node
+ *
+ * @param mask mask
+ * @param id CPU or node
+ * @return bool
+ */
+bool cpu_mask_isset(const cpu_mask_t *mask, int id)
+{
+    return id >= 0 && id < CPU_MASK_BITS && (mask->bits[id / CPU_MASK_WORD_BITS] >> (id % CPU_MASK_WORD_BITS)) & 1;
+}
+
+/**
+ * @brief Count the CPUs or nodes of a mask
+ *
+ * @param mask mask
+ * @return int
+ */
+int cpu_mask_count(const cpu_mask_t *mask)
+{
+    int cnt = 0;
+
+    for (size_t i = 0; i < CPU_MASK_BITS / CPU_MASK_WORD_BITS; i++)
+    {
+        cnt += __builtin_popcountl(mask->bits[i]);
+    }
+
+    return cnt;
+}
+
+/**
+ * @brief Keep the CPUs or nodes of a mask that are in another one
+ *
+ * @param mask mask
+ * @param other other mask
+ */
+static void cpu_mask_and(cpu_mask_t *mask, const cpu_mask_t *other)
+{
+    for (size_t i = 0; i < CPU_MASK_BITS / CPU_MASK_WORD_BITS; i++)
+    {
+        mask->bits[i] &= other->bits[i];
+    }
+}
+
+/**
+ * @brief Parse a CPU or node list, e.g. 0-3,8,10-11
+ *
+ * @param str list, a trailing newline is accepted
+ * @param mask buffer to store the CPUs or nodes
+ * @return int
+ * @retval `>=0` number of CPUs or nodes in the list
+ * @retval `-1` invalid list
+ */
+int cpu_list_parse(const char *str, cpu_mask_t *mask)
+{
+    const char *p = str;
+
+    memset(mask, 0, sizeof(*mask));
+
+    while (*p && *p != '\n')
+    {
+        char *endptr = NULL;
+        long first = strtol(p, &endptr, 10);
+        long last = first;
+
+        if (endptr == p || first < 0 || first >= CPU_MASK_BITS)
+        {
+            return -1;
+        }
+        p = endptr;
+
+        if (*p == '-')
+        {
+            last = strtol(++p, &endptr, 10);
+            if (endptr == p || last < first || last >= CPU_MASK_BITS)
+            {
+                return -1;
+            }
+            p = endptr;
+        }
+
+        for (long id = first; id <= last; id++)
+        {
+            cpu_mask_set(mask, id);
+        }
+
+        if (*p == ',')
+        {
+            p++;
+        }
+        else if (*p && *p != '\n')
+        {
+            return -1;
+        }
+    }
+
+    return cpu_mask_count(mask);
+}
+
+/**
+ * @brief Format a CPU or node mask as a list, e.g. 0-3,8
+ *
+ * @param mask mask
+ * @param buf output buffer, truncated if too small
+ * @param size size of the buffer
+ */
+void cpu_list_format(const cpu_mask_t *mask, char *buf, size_t size)
+{
+    size_t len = 0;
+
+    buf[0] = '\0';
+
+    for (int id = 0; id < CPU_MASK_BITS && len < size; id++)
+    {
+        if (!cpu_mask_isset(mask, id))
+        {
+            continue;
+        }
+
+        int last = id;
+        while (cpu_mask_isset(mask, last + 1))
+        {
+            last++;
+        }
+
+        int rc = last > id ? snprintf(buf + len, size - len, "%s%d-%d", len ? "," : "", id, last)
+                           : snprintf(buf + len, size - len, "%s%d", len ? "," : "", id);
+        if (rc < 0)
+        {
+            break;
+        }
+
+        len += rc;
+        id = last;
+    }
+}
+
+/**
+ * @brief Read a CPU or node list from sysfs
+ *
+ * @param path file, relative to SYSFS_SYSTEM_DIR
+ * @param mask buffer to store the CPUs or nodes
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int read_cpu_list(const char *path, cpu_mask_t *mask)
+{
+    char file[PATH_MAX];
+    char buf[4096];
+
+    snprintf(file, sizeof(file), "%s/%s", SYSFS_SYSTEM_DIR, path);
+
+    FILE *fp = fopen(file, "re");
+    if (!fp)
+    {
+        return -1;
+    }
+
+    char *line = fgets(buf, sizeof(buf), fp);
+    fclose(fp);
+
+    return line && cpu_list_parse(line, mask) >= 0 ? 0 : -1;
+}
+
+/**
+ * @brief Split the CPUs of a node into cores
+ *
+ * A core is made of the hardware threads listed in its
+ * thread_siblings_list, restricted to the CPUs of the node.
+ *
+ * @param node node, with its CPUs set
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int load_node_cores(numa_node_t *node)
+{
+    cpu_mask_t left = node->cpus;
+
+    node->first_core = core_cnt;
+    node->core_cnt = 0;
+
+    for (int cpu = 0; cpu < CPU_MASK_BITS; cpu++)
+    {
+        char path[64];
+        cpu_mask_t core;
+
+        if (!cpu_mask_isset(&left, cpu))
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "cpu/cpu%d/topology/thread_siblings_list", cpu);
+        if (read_cpu_list(path, &core) < 0 || !cpu_mask_isset(&core, cpu))
+        {
+            memset(&core, 0, sizeof(core));
+            cpu_mask_set(&core, cpu);
+        }
+
+        cpu_mask_and(&core, &left);
+
+        cpu_mask_t *grown = realloc(cores, (core_cnt + 1) * sizeof(cpu_mask_t));
+        if (!grown)
+        {
+            log_error("failed to realloc: %s", strerror(errno));
+            return -1;
+        }
+
+        cores = grown;
+        cores[core_cnt++] = core;
+        node->core_cnt++;
+
+        for (size_t i = 0; i < CPU_MASK_BITS / CPU_MASK_WORD_BITS; i++)
+        {
+            left.bits[i] &= ~core.bits[i];
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Load the CPU topology from sysfs
+ *
+ * Only the CPUs in the affinity of rund are used. Nodes without any of them
+ * are left out. Without NUMA support, every CPU is in a single node of id -1.
+ *
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int topology_load(void)
+{
+    cpu_mask_t online;
+
+    if (topology_loaded)
+    {
+        return 0;
+    }
+
+    if (sched_getaffinity(0, sizeof(allowed_cpus), (cpu_set_t *)&allowed_cpus) < 0)
+    {
+        log_error("failed to get CPU affinity: %s", strerror(errno));
+        return -1;
+    }
+
+    if (read_cpu_list("node/online", &online) < 0)
+    {
+        // a single node of every CPU
+        memset(&online, 0, sizeof(online));
+        cpu_mask_set(&online, 0);
+    }
+
+    nodes = calloc(cpu_mask_count(&online), sizeof(numa_node_t));
+    if (!nodes)
+    {
+        log_error("failed to calloc: %s", strerror(errno));
+        return -1;
+    }
+
+    for (int id = 0; id < CPU_MASK_BITS; id++)
+    {
+        char path[64];
+        numa_node_t *node = &nodes[node_cnt];
+
+        if (!cpu_mask_isset(&online, id))
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "node/node%d/cpulist", id);
+        if (read_cpu_list(path, &node->cpus) == 0)
+        {
+            node->id = id;
+        }
+        else if (read_cpu_list("cpu/online", &node->cpus) == 0)
+        {
+            node->id = -1;
+        }
+        else
+        {
+            log_error("failed to read the CPUs of node %d", id);
+            return -1;
+        }
+
+        cpu_mask_and(&node->cpus, &allowed_cpus);
+        if (cpu_mask_count(&node->cpus) == 0)
+        {
+            continue;
+        }
+
+        if (load_node_cores(node) < 0)
+        {
+            return -1;
+        }
+
+        node_cnt++;
+    }
+
+    if (node_cnt == 0)
+    {
+        log_error("failed to load the CPU topology: no CPU available");
+        return -1;
+    }
+
+    topology_loaded = true;
+
+    return 0;
+}
+
+/**
+ * @brief Find a node of the topology
+ *
+ * Without NUMA support, node 0 is the single node holding every CPU.
+ *
+ * @param id node id
+ * @return numa_node_t*
+ * @retval `node` node
+ * @retval `NULL` not online, or none of its CPUs is available
+ */
+static numa_node_t *find_node(int id)
+{
+    for (int i = 0; i < node_cnt; i++)
+    {
+        if (nodes[i].id == id || (nodes[i].id == -1 && id == 0))
+        {
+            return &nodes[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Resolve the CPUs and NUMA node of every replica
+ *
+ * With --cpus=auto or --numa-node=auto, replicas are spread round-robin:
+ * over the nodes first, then over the cores of each node, a core being
+ * pinned with all its hardware threads. An explicit --numa-node pins the
+ * replicas to the CPUs of the node unless --cpus is given.
+ *
+ * @param plan spawn plan, with the replicas allocated
+ * @param opt option
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int affinity_plan_init(spawn_plan_t *plan, const option_t *opt)
+{
+    numa_node_t *fixed_node = NULL;
+
+    if (opt->cpu_cnt == 0 && opt->numa_node == NUMA_NODE_NONE)
+    {
+        return 0;
+    }
+
+    if (topology_load() < 0)
+    {
+        return -1;
+    }
+
+    if (opt->numa_node >= 0)
+    {
+        fixed_node = find_node(opt->numa_node);
+        if (!fixed_node)
+        {
+            log_error("error: NUMA node %d is not online, or none of its CPUs is available", opt->numa_node);
+            return -1;
+        }
+    }
+
+    if (opt->cpu_cnt > 0)
+    {
+        cpu_mask_t available = opt->cpus;
+
+        cpu_mask_and(&available, &allowed_cpus);
+        if (cpu_mask_count(&available) == 0)
+        {
+            log_error("error: none of the CPUs given by --cpus is available");
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < plan->replica_cnt; i++)
+    {
+        spawn_replica_t *replica = &plan->replicas[i];
+        numa_node_t *node = fixed_node;
+        int core_idx = next_spread_slot;
+
+        if (!node)
+        {
+            node = &nodes[next_spread_slot % node_cnt];
+            core_idx = next_spread_slot / node_cnt;
+        }
+
+        if (opt->cpu_cnt > 0)
+        {
+            replica->cpus = opt->cpus;
+        }
+        else if (opt->cpu_cnt == CPUS_AUTO)
+        {
+            replica->core = node->first_core + core_idx % node->core_cnt;
+            replica->cpus = cores[replica->core];
+        }
+        else
+        {
+            replica->cpus = node->cpus;
+        }
+
+        replica->pin_cpus = true;
+        replica->numa_node = opt->numa_node == NUMA_NODE_NONE ? NUMA_NODE_NONE : node->id;
+
+        if (opt->cpu_cnt == CPUS_AUTO || opt->numa_node == NUMA_NODE_AUTO)
+        {
+            next_spread_slot++;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Pin every thread of a process to a set of CPUs
+ *
+ * The affinity is per thread, so the threads are listed from
+ * /proc/PID/task. Threads exiting meanwhile are ignored.
+ *
+ * @param pid process id
+ * @param cpus CPUs
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int repin_process(pid_t pid, const cpu_mask_t *cpus)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        log_error("failed to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    struct dirent *entry;
+    int rc = -1;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        pid_t tid = atoi(entry->d_name);
+
+        if (tid <= 0)
+        {
+            continue;
+        }
+
+        if (sched_setaffinity(tid, sizeof(*cpus), (const cpu_set_t *)cpus) == 0)
+        {
+            rc = 0;
+        }
+        else if (errno != ESRCH)
+        {
+            log_error("failed to set CPU affinity of %d: %s", tid, strerror(errno));
+            rc = -1;
+            break;
+        }
+    }
+
+    closedir(dir);
+
+    return rc;
+}
+
+/**
+ * @brief Move processes spread by --cpus=auto to even out the load of the
+ * cores of each node
+ *
+ * The load of a core is the CPU time of the processes on it. Each move
+ * takes the process off the hottest core of a node that brings it closest
+ * to the coldest core of the same node, so processes never leave their
+ * node. Of the possible moves, the one taking the most load off a hot core
+ * is made first, and only if it takes at least min_gain_us off: a process
+ * is never moved for a marginal gain, nor back and forth between two cores.
+ * The replicas follow, so respawns start on the new core.
+ *
+ * @param loads processes and their load, moved ones get `moved` set
+ * @param cnt number of processes
+ * @param max_moves most processes moved
+ * @param min_gain_us least load a move takes off the hottest core
+ * @return int number of processes moved
+ */
+int affinity_rebalance(affinity_load_t *loads, int cnt, int max_moves, uint64_t min_gain_us)
+{
+    int moved_cnt = 0;
+
+    if (!topology_loaded || cnt == 0)
+    {
+        return 0;
+    }
+
+    uint64_t *core_loads = calloc(core_cnt, sizeof(uint64_t));
+    if (!core_loads)
+    {
+        log_error("failed to calloc: %s", strerror(errno));
+        return 0;
+    }
+
+    for (int i = 0; i < cnt; i++)
+    {
+        core_loads[loads[i].replica->core] += loads[i].cpu_us;
+    }
+
+    while (moved_cnt < max_moves)
+    {
+        affinity_load_t *best = NULL;
+        int best_core = -1;
+        uint64_t best_gain = 0;
+
+        for (int n = 0; n < node_cnt; n++)
+        {
+            const numa_node_t *node = &nodes[n];
+            int hot = node->first_core;
+            int cold = node->first_core;
+
+            for (int c = node->first_core; c < node->first_core + node->core_cnt; c++)
+            {
+                hot = core_loads[c] > core_loads[hot] ? c : hot;
+                cold = core_loads[c] < core_loads[cold] ? c : cold;
+            }
+
+            uint64_t gap = core_loads[hot] - core_loads[cold];
+
+            for (int i = 0; i < cnt; i++)
+            {
+                affinity_load_t *load = &loads[i];
+
+                if (load->replica->core != hot || !load->movable || load->moved || load->cpu_us >= gap)
+                {
+                    continue;
+                }
+
+                // the hot core drops to the higher of the two afterwards
+                uint64_t gain = load->cpu_us < gap - load->cpu_us ? load->cpu_us : gap - load->cpu_us;
+                if (gain > best_gain)
+                {
+                    best = load;
+                    best_core = cold;
+                    best_gain = gain;
+                }
+            }
+        }
+
+        if (!best || best_gain < min_gain_us)
+        {
+            break;
+        }
+
+        // the process is not moved again this round either way
+        best->movable = false;
+
+        if (repin_process(best->pid, &cores[best_core]) < 0)
+        {
+            continue;
+        }
+
+        core_loads[best->replica->core] -= best->cpu_us;
+        core_loads[best_core] += best->cpu_us;
+
+        best->replica->core = best_core;
+        best->replica->cpus = cores[best_core];
+        best->moved = true;
+        moved_cnt++;
+    }
+
+    free(core_loads);
+
+    return moved_cnt;
+}
+
+/**
+ * @brief Release the CPU topology
+ *
+ */
+void affinity_cleanup(void)
+{
+    free(nodes);
+    nodes = NULL;
+    node_cnt = 0;
+
+    free(cores);
+    cores = NULL;
+    core_cnt = 0;
+
+    topology_loaded = false;
+    next_spread_slot = 0;
+}
@@ -0,0 +1,458 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file cgroup.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ * 2026-10-15   Frank <uuidxx@163.com>          add slot cgroups for kill mode cgroup
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+/**
+ * @brief Write a value to a cgroup interface file
+ *
+ * @param dir cgroup directory
+ * @param file interface file
+ * @param value value to write
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int cgroup_write(const char *dir, const char *file, const char *value)
+{
+    char path[PATH_MAX];
+
+    if (snprintf(path, sizeof(path), "%s/%s", dir, file) >= (int)sizeof(path))
+    {
+        log_error("failed to write %s/%s: %s", dir, file, strerror(ENAMETOOLONG));
+        return -1;
+    }
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        log_error("failed to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    if (write(fd, value, strlen(value)) < 0)
+    {
+        log_error("failed to write '%s' to %s: %s", value, path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+
+    return 0;
+}
+
+/**
+ * @brief Enable the controllers needed by the limits for the children of a cgroup
+ *
+ * The parent of the root is tried as well, so that a root created by rund
+ * gets the controllers. Only a failure on the root itself is an error.
+ *
+ * @param root cgroup root of the services
+ * @param opt option
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int enable_controllers(const char *root, const option_t *opt)
+{
+    const char *controllers[4];
+    int cnt = 0;
+    char parent[PATH_MAX];
+
+    if (opt->memory_max_bytes > 0 || opt->memory_high_bytes > 0)
+    {
+        controllers[cnt++] = "+memory";
+    }
+
+    if (opt->cpu_max_percent > 0 || opt->cpu_weight > 0)
+    {
+        controllers[cnt++] = "+cpu";
+    }
+
+    if (opt->io_weight > 0)
+    {
+        controllers[cnt++] = "+io";
+    }
+
+    if (opt->pids_max > 0)
+    {
+        controllers[cnt++] = "+pids";
+    }
+
+    char path[PATH_MAX + sizeof("/cgroup.subtree_control")];
+
+    snprintf(parent, sizeof(parent), "%s", root);
+    snprintf(path, sizeof(path), "%s/cgroup.subtree_control", dirname(parent));
+
+    for (int i = 0; i < cnt; i++)
+    {
+        // quietly, the parent may be the root cgroup or have them already
+        int fd = open(path, O_WRONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            write(fd, controllers[i], strlen(controllers[i]));
+            close(fd);
+        }
+
+        if (cgroup_write(root, "cgroup.subtree_control", controllers[i]) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write the limits of a service to its cgroup
+ *
+ * Only the limits given are written, the others keep their value.
+ *
+ * @param path cgroup of the service
+ * @param opt option
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int write_limits(const char *path, const option_t *opt)
+{
+    char value[64];
+
+    if (opt->memory_max_bytes > 0)
+    {
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)opt->memory_max_bytes);
+        if (cgroup_write(path, "memory.max", value) < 0)
+        {
+            return -1;
+        }
+    }
+
+    if (opt->memory_high_bytes > 0)
+    {
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)opt->memory_high_bytes);
+        if (cgroup_write(path, "memory.high", value) < 0)
+        {
+            return -1;
+        }
+    }
+
+    if (opt->cpu_max_percent > 0)
+    {
+        // quota per period of CGROUP_CPU_PERIOD_US
+        snprintf(value, sizeof(value), "%llu %d",
+                 (unsigned long long)opt->cpu_max_percent * CGROUP_CPU_PERIOD_US / 100,
+                 CGROUP_CPU_PERIOD_US);
+        if (cgroup_write(path, "cpu.max", value) < 0)
+        {
+            return -1;
+        }
+    }
+
+    if (opt->cpu_weight > 0)
+    {
+        snprintf(value, sizeof(value), "%d", opt->cpu_weight);
+        if (cgroup_write(path, "cpu.weight", value) < 0)
+        {
+            return -1;
+        }
+    }
+
+    if (opt->io_weight > 0)
+    {
+        snprintf(value, sizeof(value), "default %d", opt->io_weight);
+        if (cgroup_write(path, "io.weight", value) < 0)
+        {
+            return -1;
+        }
+    }
+
+    if (opt->pids_max > 0)
+    {
+        snprintf(value, sizeof(value), "%d", opt->pids_max);
+        if (cgroup_write(path, "pids.max", value) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Create the cgroup of a service and apply its limits
+ *
+ * The cgroup is ROOT/NAME, NAME being the service name or the file name of
+ * the target. A cgroup left by a previous run is reused. The directory is
+ * kept open, children are spawned straight into it.
+ *
+ * @param plan spawn plan
+ * @param opt option
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int cgroup_create(spawn_plan_t *plan, const option_t *opt)
+{
+    const char *name = opt->name;
+
+    if (!name)
+    {
+        const char *slash = strrchr(opt->target, '/');
+        name = slash ? slash + 1 : opt->target;
+    }
+
+    if (asprintf(&plan->cgroup_path, "%s/%s", opt->cgroup_root, name) < 0)
+    {
+        plan->cgroup_path = NULL;
+        log_error("failed to asprintf: %s", strerror(errno));
+        return -1;
+    }
+
+    if (mkdir(opt->cgroup_root, 0755) < 0 && errno != EEXIST)
+    {
+        log_error("failed to create cgroup %s: %s", opt->cgroup_root, strerror(errno));
+        return -1;
+    }
+
+    if (enable_controllers(opt->cgroup_root, opt) < 0)
+    {
+        return -1;
+    }
+
+    if (mkdir(plan->cgroup_path, 0755) < 0 && errno != EEXIST)
+    {
+        log_error("failed to create cgroup %s: %s", plan->cgroup_path, strerror(errno));
+        return -1;
+    }
+
+    if (write_limits(plan->cgroup_path, opt) < 0)
+    {
+        return -1;
+    }
+
+    plan->cgroup_fd = open(plan->cgroup_path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (plan->cgroup_fd < 0)
+    {
+        log_error("failed to open cgroup %s: %s", plan->cgroup_path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Close the cgroup of a service, and remove it once empty
+ *
+ * @param plan spawn plan
+ */
+void cgroup_remove(spawn_plan_t *plan)
+{
+    if (plan->cgroup_fd >= 0)
+    {
+        close(plan->cgroup_fd);
+        plan->cgroup_fd = -1;
+    }
+
+    if (plan->cgroup_path)
+    {
+        // processes left behind by the target keep it busy
+        rmdir(plan->cgroup_path);
+        free(plan->cgroup_path);
+        plan->cgroup_path = NULL;
+    }
+}
+
+/**
+ * @brief Open the cgroup of a process slot, creating it if needed
+ *
+ * With kill mode cgroup, each process slot of an instance gets its own
+ * child cgroup NAME/REPLICA.SLOT, so that killing one never touches the
+ * other replicas, nor the replacement started by a restart. The limits of
+ * the service cgroup apply to all of them.
+ *
+ * @param plan spawn plan, with the cgroup of the service created
+ * @param replica replica index
+ * @param slot process slot, 0 or 1
+ * @return int O_PATH descriptor of the cgroup, -1 on failure
+ */
+int cgroup_leaf_open(const spawn_plan_t *plan, int replica, int slot)
+{
+    char path[PATH_MAX];
+
+    if (snprintf(path, sizeof(path), "%s/%d.%d", plan->cgroup_path, replica, slot) >= (int)sizeof(path))
+    {
+        log_error("failed to create cgroup %s/%d.%d: %s", plan->cgroup_path, replica, slot, strerror(ENAMETOOLONG));
+        return -1;
+    }
+
+    if (mkdir(path, 0755) < 0 && errno != EEXIST)
+    {
+        log_error("failed to create cgroup %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    int fd = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        log_error("failed to open cgroup %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Close the cgroup of a process slot, and remove it once empty
+ *
+ * @param plan spawn plan
+ * @param replica replica index
+ * @param slot process slot, 0 or 1
+ * @param fd descriptor from cgroup_leaf_open(), ignored when negative
+ */
+void cgroup_leaf_close(const spawn_plan_t *plan, int replica, int slot, int fd)
+{
+    char path[PATH_MAX];
+
+    if (fd < 0)
+    {
+        return;
+    }
+
+    close(fd);
+
+    if (snprintf(path, sizeof(path), "%s/%d.%d", plan->cgroup_path, replica, slot) < (int)sizeof(path))
+    {
+        rmdir(path);
+    }
+}
+
+/**
+ * @brief Send a signal to every process in a cgroup
+ *
+ * SIGKILL goes through cgroup.kill, which also gets the processes forked
+ * meanwhile. Other signals, and SIGKILL on kernels before 5.14, are sent
+ * to each pid listed in cgroup.procs.
+ *
+ * @param fd O_PATH descriptor of the cgroup
+ * @param signo signal
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int cgroup_kill(int fd, int signo)
+{
+    if (signo == SIGKILL)
+    {
+        int kill_fd = openat(fd, "cgroup.kill", O_WRONLY | O_CLOEXEC);
+        if (kill_fd >= 0)
+        {
+            ssize_t rc = write(kill_fd, "1", 1);
+            close(kill_fd);
+
+            if (rc == 1)
+            {
+                return 0;
+            }
+        }
+    }
+
+    int procs_fd = openat(fd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+    if (procs_fd < 0)
+    {
+        log_error("failed to open cgroup.procs: %s", strerror(errno));
+        return -1;
+    }
+
+    FILE *fp = fdopen(procs_fd, "r");
+    if (!fp)
+    {
+        log_error("failed to fdopen: %s", strerror(errno));
+        close(procs_fd);
+        return -1;
+    }
+
+    int pid;
+    while (fscanf(fp, "%d", &pid) == 1)
+    {
+        kill(pid, signo);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+/**
+ * @brief Open cgroup.events of a cgroup
+ *
+ * The descriptor reports EPOLLPRI whenever the file changes, and is read
+ * with cgroup_populated().
+ *
+ * @param fd O_PATH descriptor of the cgroup
+ * @return int descriptor, -1 on failure
+ */
+int cgroup_events_open(int fd)
+{
+    int events_fd = openat(fd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    if (events_fd < 0)
+    {
+        log_error("failed to open cgroup.events: %s", strerror(errno));
+    }
+
+    return events_fd;
+}
+
+/**
+ * @brief Check whether a cgroup or its descendants still hold processes
+ *
+ * Reading also acknowledges the change reported by epoll.
+ *
+ * @param events_fd descriptor from cgroup_events_open()
+ * @return int
+ * @retval `1` populated
+ * @retval `0` empty
+ * @retval `-1` failed
+ */
+int cgroup_populated(int events_fd)
+{
+    char buf[128];
+
+    ssize_t len = pread(events_fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+    {
+        return -1;
+    }
+    buf[len] = '\0';
+
+    const char *populated = strstr(buf, "populated ");
+    if (!populated)
+    {
+        return -1;
+    }
+
+    return populated[sizeof("populated ") - 1] == '1';
+}
@@ -0,0 +1,845 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file config.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ * 2026-10-15   Frank <uuidxx@163.com>          count listeners in the open files limit
+ * 2026-10-15   Frank <uuidxx@163.com>          count sampled proc files in the open files limit
+ * 2026-10-15   Frank <uuidxx@163.com>          count cgroup descriptors in the open files limit
+ * 2026-10-16   Frank <uuidxx@163.com>          reject service names unfit for cgroups and the control socket
+ *
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+// Size of an arena chunk, larger strings get a chunk of their own
+#define CONFIG_CHUNK_SIZE     (64 * 1024)
+
+// Initial number of slots of the string table, must be a power of 2
+#define INTERN_TABLE_INIT_SIZE 1024
+
+// Maximum length of a key
+#define CONFIG_KEY_MAX        64
+
+// File descriptors reserved for rund itself when raising the limit
+#define CONFIG_RESERVED_FDS   64
+
+// Block of the arena holding strings and argument vectors
+struct config_chunk_s
+{
+    config_chunk_t *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+// Slot of the string table
+typedef struct
+{
+    uint32_t hash;
+    uint32_t len;
+    const char *str;
+} intern_slot_t;
+
+// State of the parser
+typedef struct
+{
+    config_t *config;
+    const char *file;
+    int line;
+
+    // strings interned so far, so identical values are stored once
+    intern_slot_t *slots;
+    size_t slot_cnt;
+    size_t str_cnt;
+
+    int service_cap;
+
+    // open files needed by the services so far, and the known soft limit
+    rlim_t fd_needed;
+    rlim_t fd_limit;
+} config_parser_t;
+
+/**
+ * @brief Allocate memory from the arena
+ *
+ * @param config config
+ * @param size size in bytes
+ * @param align alignment, must be a power of 2
+ * @return void*
+ * @retval `ptr` memory, released with the config
+ * @retval `NULL` failed
+ */
+static void *arena_alloc(config_t *config, size_t size, size_t align)
+{
+    config_chunk_t *chunk = config->arena;
+
+    if (chunk)
+    {
+        size_t offset = (chunk->used + align - 1) & ~(align - 1);
+        if (offset + size <= chunk->size)
+        {
+            chunk->used = offset + size;
+            return chunk->data + offset;
+        }
+    }
+
+    size_t chunk_size = size > CONFIG_CHUNK_SIZE ? size : CONFIG_CHUNK_SIZE;
+
+    chunk = malloc(sizeof(config_chunk_t) + chunk_size);
+    if (!chunk)
+    {
+        log_error("failed to malloc: %s", strerror(errno));
+        return NULL;
+    }
+
+    chunk->size = chunk_size;
+    chunk->used = size;
+
+    if (size == chunk_size && config->arena)
+    {
+        // keep filling the current chunk, the large one is full already
+        chunk->next = config->arena->next;
+        config->arena->next = chunk;
+    }
+    else
+    {
+        chunk->next = config->arena;
+        config->arena = chunk;
+    }
+
+    return chunk->data;
+}
+
+/**
+ * @brief Hash a string with FNV-1a
+ *
+ * @param str string, not null-terminated
+ * @param len length of the string
+ * @return uint32_t hash
+ */
+static uint32_t intern_hash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261U;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Grow the string table when it is half full
+ *
+ * @param parser parser
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int intern_table_grow(config_parser_t *parser)
+{
+    if (parser->str_cnt * 2 < parser->slot_cnt)
+    {
+        return 0;
+    }
+
+    size_t slot_cnt = parser->slot_cnt ? parser->slot_cnt * 2 : INTERN_TABLE_INIT_SIZE;
+    intern_slot_t *slots = calloc(slot_cnt, sizeof(intern_slot_t));
+    if (!slots)
+    {
+        log_error("failed to calloc: %s", strerror(errno));
+        return -1;
+    }
+
+    for (size_t i = 0; i < parser->slot_cnt; i++)
+    {
+        intern_slot_t *slot = &parser->slots[i];
+        if (!slot->str)
+        {
+            continue;
+        }
+
+        size_t idx = slot->hash & (slot_cnt - 1);
+        while (slots[idx].str)
+        {
+            idx = (idx + 1) & (slot_cnt - 1);
+        }
+
+        slots[idx] = *slot;
+    }
+
+    free(parser->slots);
+    parser->slots = slots;
+    parser->slot_cnt = slot_cnt;
+
+    return 0;
+}
+
+/**
+ * @brief Get the null-terminated copy of a string stored in the arena
+ *
+ * Identical strings share the same copy, so a value repeated by many
+ * services, like a common target path, costs memory once.
+ *
+ * @param parser parser
+ * @param str string, not null-terminated
+ * @param len length of the string
+ * @return const char*
+ * @retval `str` interned string
+ * @retval `NULL` failed
+ */
+static const char *intern(config_parser_t *parser, const char *str, size_t len)
+{
+    if (intern_table_grow(parser) < 0)
+    {
+        return NULL;
+    }
+
+    uint32_t hash = intern_hash(str, len);
+    size_t idx = hash & (parser->slot_cnt - 1);
+
+    while (parser->slots[idx].str)
+    {
+        intern_slot_t *slot = &parser->slots[idx];
+        if (slot->hash == hash && slot->len == len && memcmp(slot->str, str, len) == 0)
+        {
+            return slot->str;
+        }
+
+        idx = (idx + 1) & (parser->slot_cnt - 1);
+    }
+
+    char *copy = arena_alloc(parser->config, len + 1, 1);
+    if (!copy)
+    {
+        return NULL;
+    }
+
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+
+    parser->slots[idx].hash = hash;
+    parser->slots[idx].len = len;
+    parser->slots[idx].str = copy;
+    parser->str_cnt++;
+
+    return copy;
+}
+
+/**
+ * @brief Check whether a character is a blank
+ *
+ * @param c character
+ * @return bool
+ */
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * @brief Strip leading and trailing blanks of a range
+ *
+ * @param begin pointer to the beginning of the range
+ * @param end pointer to the end of the range
+ */
+static void trim(const char **begin, const char **end)
+{
+    while (*begin < *end && is_blank(**begin))
+    {
+        (*begin)++;
+    }
+
+    while (*end > *begin && is_blank((*end)[-1]))
+    {
+        (*end)--;
+    }
+}
+
+/**
+ * @brief Check that a service name can be used as a cgroup directory and
+ * addressed by the control socket
+ *
+ * @param parser parser
+ * @param begin beginning of the name
+ * @param end end of the name
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` invalid name
+ */
+static int check_service_name(config_parser_t *parser, const char *begin, const char *end)
+{
+    int len = (int)(end - begin);
+
+    if ((len == 1 && begin[0] == '.') || (len == 2 && begin[0] == '.' && begin[1] == '.'))
+    {
+        log_error("%s:%d: invalid service name '%.*s'", parser->file, parser->line, len, begin);
+        return -1;
+    }
+
+    for (const char *s = begin; s < end; s++)
+    {
+        // '/' would leave the cgroup root, '#' is the separator of instance names
+        if (*s == '/' || *s == '#' || isspace((unsigned char)*s))
+        {
+            log_error("%s:%d: invalid service name '%.*s': '/', '#' and blanks are not allowed",
+                      parser->file,
+                      parser->line,
+                      len,
+                      begin);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the next word of a command line
+ *
+ * Words are separated by blanks. A word enclosed in single or double quotes
+ * may contain blanks.
+ *
+ * @param p pointer to the parse position, advanced past the word
+ * @param end end of the command line
+ * @param word buffer to store the beginning of the word
+ * @param len buffer to store the length of the word
+ * @return int
+ * @retval `1` got a word
+ * @retval `0` no more words
+ * @retval `-1` unterminated quote
+ */
+static int next_word(const char **p, const char *end, const char **word, size_t *len)
+{
+    const char *s = *p;
+
+    while (s < end && is_blank(*s))
+    {
+        s++;
+    }
+
+    if (s == end)
+    {
+        *p = s;
+        return 0;
+    }
+
+    if (*s == '"' || *s == '\'')
+    {
+        const char *close = memchr(s + 1, *s, end - s - 1);
+        if (!close)
+        {
+            return -1;
+        }
+
+        *word = s + 1;
+        *len = close - s - 1;
+        *p = close + 1;
+        return 1;
+    }
+
+    *word = s;
+    while (s < end && !is_blank(*s))
+    {
+        s++;
+    }
+
+    *len = s - *word;
+    *p = s;
+
+    return 1;
+}
+
+/**
+ * @brief Set the target and its arguments of a service from a command line
+ *
+ * @param parser parser
+ * @param opt option of the service
+ * @param begin beginning of the command line
+ * @param end end of the command line
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_command(config_parser_t *parser, option_t *opt, const char *begin, const char *end)
+{
+    const char *p = begin;
+    const char *word;
+    size_t len;
+    int cnt = 0;
+    int rc;
+
+    while ((rc = next_word(&p, end, &word, &len)) > 0)
+    {
+        cnt++;
+    }
+
+    if (rc < 0)
+    {
+        log_error("%s:%d: unterminated quote", parser->file, parser->line);
+        return -1;
+    }
+
+    if (cnt == 0)
+    {
+        log_error("%s:%d: empty command", parser->file, parser->line);
+        return -1;
+    }
+
+    char **argv = arena_alloc(parser->config, (cnt + 1) * sizeof(char *), sizeof(char *));
+    if (!argv)
+    {
+        return -1;
+    }
+
+    p = begin;
+    for (int i = 0; i < cnt; i++)
+    {
+        next_word(&p, end, &word, &len);
+
+        // execve() does not modify its arguments
+        argv[i] = (char *)intern(parser, word, len);
+        if (!argv[i])
+        {
+            return -1;
+        }
+    }
+
+    argv[cnt] = NULL;
+
+    opt->target = argv[0];
+    opt->target_argc = cnt;
+    opt->target_argv = argv;
+
+    return 0;
+}
+
+/**
+ * @brief Make sure the soft limit of open files allows the next service
+ *
+ * Each service holds its target, log files, listeners and cgroup open, and each running
+ * replica a pidfd and an error pipe while spawning, which quickly exceeds
+ * the usual soft limit of 1024. The limit is raised by doubling it, up to
+ * the hard limit, and is inherited by the targets.
+ *
+ * @param parser parser
+ * @param opt option of the next service
+ */
+static void reserve_fds(config_parser_t *parser, const option_t *opt)
+{
+    struct rlimit rl;
+
+    // a sampled replica holds its proc file open, twice during a restart
+    rlim_t fds_per_replica = opt->max_rss_bytes > 0 || opt->max_cpu_percent > 0 ? 4 : 2;
+
+    parser->fd_needed += 3 + opt->listen_cnt + (opt->cgroup_root ? 1 : 0) + (rlim_t)opt->replica_cnt * fds_per_replica;
+    if (parser->fd_needed <= parser->fd_limit)
+    {
+        return;
+    }
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+    {
+        return;
+    }
+
+    if (rl.rlim_cur < parser->fd_needed && rl.rlim_cur < rl.rlim_max)
+    {
+        rlim_t cur = rl.rlim_cur * 2 > parser->fd_needed ? rl.rlim_cur * 2 : parser->fd_needed;
+
+        rl.rlim_cur = cur < rl.rlim_max ? cur : rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
+        {
+            log_warn("failed to raise open files limit: %s", strerror(errno));
+            getrlimit(RLIMIT_NOFILE, &rl);
+        }
+    }
+
+    // do not try again before the limit is reached
+    parser->fd_limit = rl.rlim_cur > parser->fd_needed ? rl.rlim_cur : parser->fd_needed;
+}
+
+/**
+ * @brief Finish the service being parsed
+ *
+ * @param parser parser
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int end_service(config_parser_t *parser)
+{
+    config_t *config = parser->config;
+
+    if (config->service_cnt == 0)
+    {
+        return 0;
+    }
+
+    option_t *opt = &config->services[config->service_cnt - 1];
+
+    if (!opt->target)
+    {
+        log_error("%s: service '%s' has no command", parser->file, opt->name);
+        return -1;
+    }
+
+    reserve_fds(parser, opt);
+
+    if (finalize_option(opt) < 0)
+    {
+        log_error("%s: invalid service '%s'", parser->file, opt->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Start a new service from a section header
+ *
+ * @param parser parser
+ * @param begin beginning of the section name
+ * @param end end of the section name
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int begin_service(config_parser_t *parser, const char *begin, const char *end)
+{
+    config_t *config = parser->config;
+    option_t init = OPTION_INITIALIZER;
+
+    trim(&begin, &end);
+    if (begin == end)
+    {
+        log_error("%s:%d: empty service name", parser->file, parser->line);
+        return -1;
+    }
+
+    if (check_service_name(parser, begin, end) < 0)
+    {
+        return -1;
+    }
+
+    if (end_service(parser) < 0)
+    {
+        return -1;
+    }
+
+    if (config->service_cnt == parser->service_cap)
+    {
+        int cap = parser->service_cap ? parser->service_cap * 2 : 16;
+        option_t *temp = realloc(config->services, cap * sizeof(option_t));
+        if (!temp)
+        {
+            log_error("failed to realloc: %s", strerror(errno));
+            return -1;
+        }
+
+        config->services = temp;
+        parser->service_cap = cap;
+    }
+
+    init.name = intern(parser, begin, end - begin);
+    if (!init.name)
+    {
+        return -1;
+    }
+
+    config->services[config->service_cnt++] = init;
+
+    return 0;
+}
+
+/**
+ * @brief Parse a line of the config file
+ *
+ * @param parser parser
+ * @param begin beginning of the line
+ * @param end end of the line, without the newline
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_line(config_parser_t *parser, const char *begin, const char *end)
+{
+    config_t *config = parser->config;
+
+    trim(&begin, &end);
+
+    // blank line or comment
+    if (begin == end || *begin == '#' || *begin == ';')
+    {
+        return 0;
+    }
+
+    if (*begin == '[')
+    {
+        if (end[-1] != ']' || end - begin < 2)
+        {
+            log_error("%s:%d: invalid section header", parser->file, parser->line);
+            return -1;
+        }
+
+        return begin_service(parser, begin + 1, end - 1);
+    }
+
+    const char *sep = memchr(begin, '=', end - begin);
+    if (!sep)
+    {
+        log_error("%s:%d: expected KEY = VALUE", parser->file, parser->line);
+        return -1;
+    }
+
+    if (config->service_cnt == 0)
+    {
+        log_error("%s:%d: option outside of a service section", parser->file, parser->line);
+        return -1;
+    }
+
+    option_t *opt = &config->services[config->service_cnt - 1];
+    const char *key = begin;
+    const char *key_end = sep;
+    const char *value = sep + 1;
+    const char *value_end = end;
+    char key_buf[CONFIG_KEY_MAX];
+
+    trim(&key, &key_end);
+    trim(&value, &value_end);
+
+    if (key == key_end || (size_t)(key_end - key) >= sizeof(key_buf))
+    {
+        log_error("%s:%d: invalid key", parser->file, parser->line);
+        return -1;
+    }
+
+    memcpy(key_buf, key, key_end - key);
+    key_buf[key_end - key] = '\0';
+
+    if (strcmp(key_buf, "command") == 0)
+    {
+        return parse_command(parser, opt, value, value_end);
+    }
+
+    const char *value_str = intern(parser, value, value_end - value);
+    if (!value_str)
+    {
+        return -1;
+    }
+
+    if (set_option(opt, key_buf, value_str) < 0)
+    {
+        log_error("%s:%d: invalid option '%s' of service '%s'", parser->file, parser->line, key_buf, opt->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Compare two interned strings by address
+ *
+ * @param a pointer to the first string
+ * @param b pointer to the second string
+ * @return int
+ */
+static int compare_ptr(const void *a, const void *b)
+{
+    const char *pa = *(const char *const *)a;
+    const char *pb = *(const char *const *)b;
+
+    return (pa > pb) - (pa < pb);
+}
+
+/**
+ * @brief Check that every service has a unique name
+ *
+ * Names are interned, so duplicates have the same address.
+ *
+ * @param parser parser
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int check_duplicate_names(config_parser_t *parser)
+{
+    config_t *config = parser->config;
+    int rc = 0;
+
+    const char **names = malloc(config->service_cnt * sizeof(char *));
+    if (!names)
+    {
+        log_error("failed to malloc: %s", strerror(errno));
+        return -1;
+    }
+
+    for (int i = 0; i < config->service_cnt; i++)
+    {
+        names[i] = config->services[i].name;
+    }
+
+    qsort(names, config->service_cnt, sizeof(char *), compare_ptr);
+
+    for (int i = 1; i < config->service_cnt; i++)
+    {
+        if (names[i] == names[i - 1])
+        {
+            log_error("%s: duplicate service '%s'", parser->file, names[i]);
+            rc = -1;
+            break;
+        }
+    }
+
+    free(names);
+
+    return rc;
+}
+
+/**
+ * @brief Load services from a config file
+ *
+ * The file is made of sections, one per service, named after the service.
+ * The keys of a section are the long options of rund, and `command` gives
+ * the target and its arguments:
+ *
+ *     [web]
+ *     command = /usr/bin/python3 -m http.server 8080
+ *     respawn = yes
+ *     env = PYTHONUNBUFFERED=1
+ *
+ * The file is mapped rather than read, and only the strings referenced by
+ * the services are copied, once each, into the arena of the config.
+ *
+ * @param config config buffer
+ * @param file config file path
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int config_load(config_t *config, const char *file)
+{
+    struct stat st;
+    const char *data = NULL;
+    int rc = 0;
+    config_parser_t parser = {
+        .config = config,
+        .file = file,
+        .fd_needed = CONFIG_RESERVED_FDS,
+    };
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        log_error("failed to open %s: %s", file, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0)
+    {
+        log_error("failed to stat %s: %s", file, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size > 0)
+    {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            log_error("failed to mmap %s: %s", file, strerror(errno));
+            close(fd);
+            return -1;
+        }
+
+        madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+
+    for (const char *p = data, *end = data + st.st_size; p < end;)
+    {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol)
+        {
+            eol = end;
+        }
+
+        parser.line++;
+
+        rc = parse_line(&parser, p, eol);
+        if (rc < 0)
+        {
+            break;
+        }
+
+        p = eol + 1;
+    }
+
+    if (rc == 0)
+    {
+        rc = end_service(&parser);
+    }
+
+    if (rc == 0 && config->service_cnt == 0)
+    {
+        log_error("%s: no service defined", file);
+        rc = -1;
+    }
+
+    if (rc == 0)
+    {
+        rc = check_duplicate_names(&parser);
+    }
+
+    free(parser.slots);
+
+    if (data)
+    {
+        munmap((void *)data, st.st_size);
+    }
+
+    return rc;
+}
+
+/**
+ * @brief Free the services loaded from a config file
+ *
+ * @param config config
+ */
+void config_free(config_t *config)
+{
+    for (int i = 0; i < config->service_cnt; i++)
+    {
+        free_option(&config->services[i]);
+    }
+
+    free(config->services);
+    config->services = NULL;
+    config->service_cnt = 0;
+
+    while (config->arena)
+    {
+        config_chunk_t *next = config->arena->next;
+        free(config->arena);
+        config->arena = next;
+    }
+}
@@ -0,0 +1,433 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file control.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ * 2026-10-15   Frank <uuidxx@163.com>          add latency command
+ * 2026-10-16   Frank <uuidxx@163.com>          share the socket in use check with listeners
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+// Maximum length of a command line
+#define CONTROL_LINE_MAX 256
+
+// Connection of a control client
+typedef struct control_client_s control_client_t;
+
+struct control_client_s
+{
+    event_t event;
+
+    // command line received so far
+    char in[CONTROL_LINE_MAX];
+    size_t in_len;
+
+    // reply, sent before closing the connection
+    char *out;
+    size_t out_len;
+    size_t out_off;
+
+    control_client_t *prev;
+    control_client_t *next;
+};
+
+static event_t listen_event = {.fd = -1};
+static char *socket_path = NULL;
+
+// connected clients
+static control_client_t *clients = NULL;
+
+/**
+ * @brief Close the connection of a client
+ *
+ * @param client client
+ */
+static void client_close(control_client_t *client)
+{
+    event_del(&client->event);
+    close(client->event.fd);
+    client->event.fd = -1;
+
+    if (client->prev)
+    {
+        client->prev->next = client->next;
+    }
+    else
+    {
+        clients = client->next;
+    }
+
+    if (client->next)
+    {
+        client->next->prev = client->prev;
+    }
+
+    free(client->out);
+    free(client);
+}
+
+/**
+ * @brief Execute a command
+ *
+ * @param line command line, null-terminated without the newline
+ * @param stream stream to write the reply to
+ */
+static void execute_command(char *line, FILE *stream)
+{
+    char *saveptr = NULL;
+    char *cmd = strtok_r(line, " \t\r", &saveptr);
+    char *arg = strtok_r(NULL, " \t\r", &saveptr);
+
+    if (!cmd)
+    {
+        fprintf(stream, "error: empty command\n");
+    }
+    else if (strcmp(cmd, "status") == 0)
+    {
+        supervisor_write_status(stream);
+    }
+    else if (strcmp(cmd, "latency") == 0)
+    {
+        supervisor_write_latency(stream);
+    }
+    else if (strcmp(cmd, "restart") == 0)
+    {
+        int cnt = supervisor_restart(arg);
+        if (cnt < 0)
+        {
+            fprintf(stream, "error: no such service '%s'\n", arg);
+        }
+        else
+        {
+            log_info("restart %s requested, restarting %d instances", arg ? arg : "all", cnt);
+            fprintf(stream, "ok: restarting %d instances\n", cnt);
+        }
+    }
+    else
+    {
+        fprintf(stream, "error: unknown command '%s'\n", cmd);
+    }
+}
+
+/**
+ * @brief Send the pending reply to a client
+ *
+ * @param client client
+ * @return int
+ * @retval `1` the whole reply was sent
+ * @retval `0` the socket is full, try again when writable
+ * @retval `-1` failed
+ */
+static int client_flush(control_client_t *client)
+{
+    while (client->out_off < client->out_len)
+    {
+        ssize_t len = send(client->event.fd,
+                           client->out + client->out_off,
+                           client->out_len - client->out_off,
+                           MSG_NOSIGNAL);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return errno == EAGAIN ? 0 : -1;
+        }
+
+        client->out_off += len;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Execute the command of a client and start sending the reply
+ *
+ * @param client client
+ * @param overflow the command line does not fit in the buffer
+ */
+static void client_reply(control_client_t *client, bool overflow)
+{
+    FILE *stream = open_memstream(&client->out, &client->out_len);
+    if (!stream)
+    {
+        log_error("failed to open memstream: %s", strerror(errno));
+        client_close(client);
+        return;
+    }
+
+    if (overflow)
+    {
+        fprintf(stream, "error: command longer than %d bytes\n", CONTROL_LINE_MAX - 2);
+    }
+    else
+    {
+        client->in[client->in_len] = '\0';
+        execute_command(client->in, stream);
+    }
+    fclose(stream);
+
+    int rc = client_flush(client);
+    if (rc != 0)
+    {
+        client_close(client);
+        return;
+    }
+
+    // wait until the socket can take the rest of the reply
+    if (event_mod(&client->event, EPOLLOUT) < 0)
+    {
+        client_close(client);
+    }
+}
+
+/**
+ * @brief Handle events of a client connection
+ *
+ * A client sends a single command line and gets the reply before the
+ * connection is closed.
+ *
+ * @param ev event
+ * @param events ready events
+ */
+static void client_handler(event_t *ev, uint32_t events)
+{
+    control_client_t *client = ev->data;
+
+    if (client->out)
+    {
+        if (client_flush(client) != 0)
+        {
+            client_close(client);
+        }
+        return;
+    }
+
+    while (1)
+    {
+        ssize_t len = read(ev->fd, client->in + client->in_len, sizeof(client->in) - 1 - client->in_len);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno != EAGAIN)
+            {
+                client_close(client);
+            }
+            return;
+        }
+
+        if (len == 0)
+        {
+            // a command without newline is still a command
+            if (client->in_len > 0)
+            {
+                client_reply(client, false);
+            }
+            else
+            {
+                client_close(client);
+            }
+            return;
+        }
+
+        char *eol = memchr(client->in + client->in_len, '\n', len);
+        client->in_len += len;
+
+        if (eol)
+        {
+            client->in_len = eol - client->in;
+            client_reply(client, false);
+            return;
+        }
+
+        if (client->in_len == sizeof(client->in) - 1)
+        {
+            client_reply(client, true);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Accept pending client connections
+ *
+ * @param ev event
+ * @param events ready events
+ */
+static void listen_handler(event_t *ev, uint32_t events)
+{
+    while (1)
+    {
+        int fd = accept4(ev->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno != EAGAIN)
+            {
+                log_error("failed to accept control connection: %s", strerror(errno));
+            }
+            return;
+        }
+
+        control_client_t *client = calloc(1, sizeof(control_client_t));
+        if (!client)
+        {
+            log_error("failed to calloc: %s", strerror(errno));
+            close(fd);
+            continue;
+        }
+
+        client->event.fd = fd;
+        client->event.handler = client_handler;
+        client->event.data = client;
+
+        if (event_add(&client->event, EPOLLIN) < 0)
+        {
+            close(fd);
+            free(client);
+            continue;
+        }
+
+        client->next = clients;
+        if (clients)
+        {
+            clients->prev = client;
+        }
+        clients = client;
+    }
+}
+
+/**
+ * @brief Listen for commands on a unix socket
+ *
+ * Each connection carries one command line, and is closed once the reply
+ * is sent:
+ *
+ * - `status`: state of every instance, one per line
+ * - `latency`: p50, p99 and max probe latency of every probed service
+ * - `restart [NAME]`: restart a service, an instance or everything
+ *   without downtime
+ *
+ * @param file socket path
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int control_init(const char *file)
+{
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX,
+    };
+    struct stat st;
+
+    if (strlen(file) >= sizeof(addr.sun_path))
+    {
+        log_error("failed to bind %s: %s", file, strerror(ENAMETOOLONG));
+        return -1;
+    }
+
+    strcpy(addr.sun_path, file);
+
+    // remove the socket left by a previous run, unless it is still in use
+    if (lstat(file, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        if (unix_socket_in_use(file))
+        {
+            log_error("failed to bind %s: %s", file, strerror(EADDRINUSE));
+            return -1;
+        }
+
+        unlink(file);
+    }
+
+    listen_event.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_event.fd < 0)
+    {
+        log_error("failed to create socket: %s", strerror(errno));
+        return -1;
+    }
+
+    if (bind(listen_event.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        log_error("failed to bind %s: %s", file, strerror(errno));
+        close(listen_event.fd);
+        listen_event.fd = -1;
+        return -1;
+    }
+
+    socket_path = strdup(file);
+
+    // commands control every service, only the owner may send them
+    chmod(file, S_IRUSR | S_IWUSR);
+
+    if (listen(listen_event.fd, SOMAXCONN) < 0)
+    {
+        log_error("failed to listen on %s: %s", file, strerror(errno));
+        control_cleanup();
+        return -1;
+    }
+
+    listen_event.handler = listen_handler;
+
+    if (event_add(&listen_event, EPOLLIN) < 0)
+    {
+        control_cleanup();
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Close the control socket and all client connections
+ *
+ */
+void control_cleanup(void)
+{
+    while (clients)
+    {
+        client_close(clients);
+    }
+
+    if (listen_event.fd >= 0)
+    {
+        event_del(&listen_event);
+        close(listen_event.fd);
+        listen_event.fd = -1;
+    }
+
+    if (socket_path)
+    {
+        unlink(socket_path);
+        free(socket_path);
+        socket_path = NULL;
+    }
+}
@@ -8,6 +8,8 @@
  * @section Changelog
  * Date         Author                          Notes
  * 2025-12-22   Frank <uuidxx@163.com>          the first version
+ * 2026-10-15   Frank <uuidxx@163.com>          keep the pid file out of spawned children
+ * 2026-10-15   Frank <uuidxx@163.com>          close the /dev/null descriptor after redirection
  *
  */
 
@@ -50,7 +52,7 @@ static int lock_pid_file(int fd)
  */
 int test_running(const char *pid_file)
 {
-    int fd = open(pid_file, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    int fd = open(pid_file, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
     if (fd < 0)
     {
         log_error("failed to open %s: %s", pid_file, strerror(errno));
@@ -183,5 +185,10 @@ int daemonize(const char *pid_file)
     dup2(null_fd, STDOUT_FILENO);
     dup2(null_fd, STDERR_FILENO);
 
+    if (null_fd > STDERR_FILENO)
+    {
+        close(null_fd);
+    }
+
     return pid_fd;
 }
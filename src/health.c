@@ -0,0 +1,416 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file health.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ * 2026-10-15   Frank <uuidxx@163.com>          measure probe latency
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+// Host probed when a TCP probe only gives a port
+#define HEALTH_DEFAULT_HOST "127.0.0.1"
+
+// number of probe commands not reaped yet
+static size_t probe_proc_cnt = 0;
+
+/**
+ * @brief Resolve the address of a socket probe
+ *
+ * @param opt option, `health_probe` must be set
+ * @param addr [HOST:]PORT for TCP, HOST may be in brackets, or a unix socket path
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int health_resolve(option_t *opt, const char *addr)
+{
+    if (opt->health_probe == HEALTH_PROBE_UNIX)
+    {
+        struct sockaddr_un *un = (struct sockaddr_un *)&opt->health_addr;
+
+        if (*addr == '\0' || strlen(addr) >= sizeof(un->sun_path))
+        {
+            log_error("failed to parse health probe '%s': invalid path", addr);
+            return -1;
+        }
+
+        memset(un, 0, sizeof(*un));
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, addr);
+        opt->health_addr_len = sizeof(*un);
+
+        return 0;
+    }
+
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = AI_NUMERICSERV,
+    };
+    struct addrinfo *res = NULL;
+    char host[NI_MAXHOST] = HEALTH_DEFAULT_HOST;
+    const char *port = strrchr(addr, ':');
+
+    if (port)
+    {
+        size_t len = port - addr;
+
+        if (len >= 2 && addr[0] == '[' && addr[len - 1] == ']')
+        {
+            addr++;
+            len -= 2;
+        }
+
+        if (len >= sizeof(host))
+        {
+            log_error("failed to parse health probe '%s': %s", addr, strerror(ENAMETOOLONG));
+            return -1;
+        }
+
+        if (len > 0)
+        {
+            memcpy(host, addr, len);
+            host[len] = '\0';
+        }
+
+        port++;
+    }
+    else
+    {
+        port = addr;
+    }
+
+    int rc = getaddrinfo(host, port, &hints, &res);
+    if (rc != 0)
+    {
+        log_error("failed to resolve health probe '%s': %s", addr, gai_strerror(rc));
+        return -1;
+    }
+
+    memcpy(&opt->health_addr, res->ai_addr, res->ai_addrlen);
+    opt->health_addr_len = res->ai_addrlen;
+
+    freeaddrinfo(res);
+
+    return 0;
+}
+
+/**
+ * @brief Report the result of a probe and release its resources
+ *
+ * @param check health check
+ * @param ok whether the probe succeeded
+ * @param reason cause of the failure
+ */
+static void check_done(health_check_t *check, bool ok, const char *reason)
+{
+    event_timer_stop(&check->timeout_timer);
+
+    if (check->event.fd >= 0)
+    {
+        event_del(&check->event);
+        close(check->event.fd);
+        check->event.fd = -1;
+    }
+
+    check->latency_us = event_now_us() - check->started_us;
+    check->running = false;
+    check->on_result(check, ok, reason);
+}
+
+/**
+ * @brief Handle the completion of a non-blocking connect
+ *
+ * @param ev event
+ * @param events ready events
+ */
+static void connect_handler(event_t *ev, uint32_t events)
+{
+    health_check_t *check = ev->data;
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (getsockopt(ev->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+    {
+        err = errno;
+    }
+
+    check_done(check, err == 0, strerror(err));
+}
+
+/**
+ * @brief Start a socket probe
+ *
+ * @param check health check
+ * @return int
+ * @retval `0` ok, the result is reported later, or already reported
+ * @retval `-1` failed to start
+ */
+static int run_connect(health_check_t *check)
+{
+    const option_t *opt = check->opt;
+
+    int fd = socket(opt->health_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        log_error("failed to create socket: %s", strerror(errno));
+        return -1;
+    }
+
+    if (connect(fd, (const struct sockaddr *)&opt->health_addr, opt->health_addr_len) == 0)
+    {
+        // unix sockets, and sometimes loopback, connect at once
+        close(fd);
+        check_done(check, true, NULL);
+        return 0;
+    }
+
+    if (errno != EINPROGRESS && errno != EAGAIN)
+    {
+        int err = errno;
+
+        close(fd);
+        check_done(check, false, strerror(err));
+        return 0;
+    }
+
+    check->event.fd = fd;
+    if (event_add(&check->event, EPOLLOUT) < 0)
+    {
+        close(fd);
+        check->event.fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Handle the exit of a probe command
+ *
+ * @param proc process
+ * @param status status from waitpid()
+ */
+static void probe_exit_handler(proc_t *proc, int status)
+{
+    health_check_t *check = proc->data;
+
+    check->proc.pid = -1;
+    probe_proc_cnt--;
+
+    if (check->cancelled)
+    {
+        check->cancelled = false;
+        return;
+    }
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        check_done(check, true, NULL);
+    }
+    else if (WIFEXITED(status))
+    {
+        char reason[32];
+
+        snprintf(reason, sizeof(reason), "exit status %d", WEXITSTATUS(status));
+        check_done(check, false, reason);
+    }
+    else
+    {
+        check_done(check, false, WIFSIGNALED(status) ? strsignal(WTERMSIG(status)) : "abnormal exit");
+    }
+}
+
+/**
+ * @brief Start a command probe
+ *
+ * @param check health check
+ * @param sigmask signal mask to restore in the child
+ * @return int
+ * @retval `0` ok, the result is reported when the command exits
+ * @retval `-1` failed to start
+ */
+static int run_command(health_check_t *check, const sigset_t *sigmask)
+{
+    int pidfd;
+
+    // a cancelled command still running is killed, wait until it is reaped
+    if (check->proc.pid >= 0)
+    {
+        return -1;
+    }
+
+    pid_t pid = spawn_command(check->opt, check->replica, sigmask, check->opt->health_argv, &pidfd);
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    if (proc_watch(&check->proc, pid, pidfd) < 0)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        check->proc.pid = -1;
+        return -1;
+    }
+
+    probe_proc_cnt++;
+
+    return 0;
+}
+
+/**
+ * @brief Handle the timeout of a probe
+ *
+ * @param timer timeout timer
+ */
+static void timeout_handler(event_timer_t *timer)
+{
+    health_check_t *check = timer->data;
+    char reason[64];
+
+    snprintf(reason, sizeof(reason), "timed out after %llu ms", (unsigned long long)check->opt->health_timeout_ms);
+
+    if (check->proc.pid >= 0)
+    {
+        // the command runs in its own session, kill whatever it started
+        kill(-check->proc.pid, SIGKILL);
+        check->cancelled = true;
+    }
+
+    check_done(check, false, reason);
+}
+
+/**
+ * @brief Initialize the health check of an instance
+ *
+ * `on_result` and `data` are set by the caller.
+ *
+ * @param check health check
+ * @param opt option of the service
+ * @param replica replica index of the instance
+ */
+void health_check_init(health_check_t *check, const option_t *opt, int replica)
+{
+    check->opt = opt;
+    check->replica = replica;
+    check->running = false;
+
+    check->event.fd = -1;
+    check->event.handler = connect_handler;
+    check->event.data = check;
+
+    check->proc.pid = -1;
+    check->proc.pidfd = -1;
+    check->proc.event.fd = -1;
+    check->proc.on_exit = probe_exit_handler;
+    check->proc.data = check;
+    check->cancelled = false;
+
+    check->timeout_timer.handler = timeout_handler;
+    check->timeout_timer.data = check;
+}
+
+/**
+ * @brief Run a probe
+ *
+ * Never blocks: sockets connect in the background and commands are watched
+ * like targets, their result is reported to `on_result` from the event loop.
+ * A probe that cannot be started is reported as failed right away.
+ *
+ * @param check health check, with no probe in flight
+ * @param sigmask signal mask to restore in the child of a command probe
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` a probe is already in flight
+ */
+int health_check_run(health_check_t *check, const sigset_t *sigmask)
+{
+    int rc;
+
+    if (check->running)
+    {
+        return -1;
+    }
+
+    check->running = true;
+    check->started_us = event_now_us();
+    event_timer_start(&check->timeout_timer, check->opt->health_timeout_ms);
+
+    if (check->opt->health_probe == HEALTH_PROBE_CMD)
+    {
+        rc = run_command(check, sigmask);
+    }
+    else
+    {
+        rc = run_connect(check);
+    }
+
+    if (rc < 0)
+    {
+        check_done(check, false, "failed to start");
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Cancel the probe in flight, its result is not reported
+ *
+ * A probe command is killed, and stays watched until it is reaped.
+ *
+ * @param check health check
+ */
+void health_check_cancel(health_check_t *check)
+{
+    if (!check->running)
+    {
+        return;
+    }
+
+    check->running = false;
+    event_timer_stop(&check->timeout_timer);
+
+    if (check->event.fd >= 0)
+    {
+        event_del(&check->event);
+        close(check->event.fd);
+        check->event.fd = -1;
+    }
+
+    if (check->proc.pid >= 0)
+    {
+        kill(-check->proc.pid, SIGKILL);
+        check->cancelled = true;
+    }
+}
+
+/**
+ * @brief Get the number of probe commands not reaped yet
+ *
+ * @return size_t
+ */
+size_t health_check_proc_cnt(void)
+{
+    return probe_proc_cnt;
+}
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file histogram.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ *
+ */
+
+#include <string.h>
+
+#include "internal.h"
+
+/**
+ * @brief Get the bucket of a value
+ *
+ * Values below HISTOGRAM_SUB_CNT have a bucket each. Above, every power of
+ * two is split into HISTOGRAM_SUB_CNT buckets, indexed by the bits that
+ * follow the most significant one.
+ *
+ * @param us value, at most UINT32_MAX
+ * @return size_t
+ */
+static size_t bucket_index(uint32_t us)
+{
+    if (us < HISTOGRAM_SUB_CNT)
+    {
+        return us;
+    }
+
+    int shift = 31 - __builtin_clz(us) - HISTOGRAM_SUB_BITS;
+
+    return (size_t)(shift + 1) * HISTOGRAM_SUB_CNT + ((us >> shift) & (HISTOGRAM_SUB_CNT - 1));
+}
+
+/**
+ * @brief Get the highest value of a bucket
+ *
+ * @param idx bucket index
+ * @return uint64_t
+ */
+static uint64_t bucket_highest(size_t idx)
+{
+    if (idx < HISTOGRAM_SUB_CNT)
+    {
+        return idx;
+    }
+
+    int shift = idx / HISTOGRAM_SUB_CNT - 1;
+    uint64_t lowest = (uint64_t)(HISTOGRAM_SUB_CNT + idx % HISTOGRAM_SUB_CNT) << shift;
+
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+/**
+ * @brief Empty a histogram
+ *
+ * @param hist histogram
+ */
+void histogram_reset(histogram_t *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+}
+
+/**
+ * @brief Record a latency
+ *
+ * @param hist histogram
+ * @param us latency in microseconds, larger values count as UINT32_MAX
+ */
+void histogram_record(histogram_t *hist, uint64_t us)
+{
+    if (us > UINT32_MAX)
+    {
+        us = UINT32_MAX;
+    }
+
+    hist->counts[bucket_index(us)]++;
+    hist->total++;
+
+    if (us > hist->max_us)
+    {
+        hist->max_us = us;
+    }
+}
+
+/**
+ * @brief Get a percentile of the recorded latencies
+ *
+ * The result is the highest value of the bucket holding the percentile,
+ * never more than the maximum recorded.
+ *
+ * @param hist histogram
+ * @param percentile percentile, from 0 to 100
+ * @return uint64_t latency in microseconds, 0 when empty
+ */
+uint64_t histogram_percentile(const histogram_t *hist, double percentile)
+{
+    // rank of the percentile, rounded up, at least the first value
+    uint64_t rank = (uint64_t)(hist->total * percentile / 100);
+    uint64_t seen = 0;
+
+    if ((double)rank < hist->total * percentile / 100 || rank == 0)
+    {
+        rank++;
+    }
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t us = bucket_highest(i);
+            return us < hist->max_us ? us : hist->max_us;
+        }
+    }
+
+    return hist->max_us;
+}
@@ -9,22 +9,241 @@
  * Date         Author                          Notes
  * 2025-12-22   Frank <uuidxx@163.com>          the first version
  * 2025-12-25   Frank <uuidxx@163.com>          add support for running user
+ * 2026-10-15   Frank <uuidxx@163.com>          add event loop and pidfd based process watcher
+ * 2026-10-15   Frank <uuidxx@163.com>          add spawn backends
+ * 2026-10-15   Frank <uuidxx@163.com>          add spawn plan
+ * 2026-10-15   Frank <uuidxx@163.com>          add supervisor with multiple replicas
+ * 2026-10-15   Frank <uuidxx@163.com>          add config file
+ * 2026-10-15   Frank <uuidxx@163.com>          add respawn backoff
+ * 2026-10-15   Frank <uuidxx@163.com>          add respawn rate limit
+ * 2026-10-15   Frank <uuidxx@163.com>          add zero-downtime restart and control socket
+ * 2026-10-15   Frank <uuidxx@163.com>          add socket activation
+ * 2026-10-15   Frank <uuidxx@163.com>          add sd_notify readiness protocol
+ * 2026-10-15   Frank <uuidxx@163.com>          add watchdog
+ * 2026-10-15   Frank <uuidxx@163.com>          add health probes
+ * 2026-10-15   Frank <uuidxx@163.com>          add probe latency histograms
+ * 2026-10-15   Frank <uuidxx@163.com>          add RSS and CPU usage watchdog
+ * 2026-10-15   Frank <uuidxx@163.com>          add RSS trend recycling
+ * 2026-10-15   Frank <uuidxx@163.com>          add cgroup placement and limits
+ * 2026-10-15   Frank <uuidxx@163.com>          add kill modes
+ * 2026-10-15   Frank <uuidxx@163.com>          add child subreaper
+ * 2026-10-16   Frank <uuidxx@163.com>          add CPU affinity and NUMA node pinning
+ * 2026-10-16   Frank <uuidxx@163.com>          add CPU load rebalancing
+ * 2026-10-16   Frank <uuidxx@163.com>          add scheduling, IO priority and OOM score controls
+ * 2026-10-16   Frank <uuidxx@163.com>          add resource limits
+ * 2026-10-16   Frank <uuidxx@163.com>          open the spawn plan after daemonizing
+ * 2026-10-16   Frank <uuidxx@163.com>          track stopped services
  *
  */
 
 #ifndef _INTERNAL_H_
 #define _INTERNAL_H_
 
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 
 #define RESPAWN_CODE_BITS_ARRAY_SIZE 4
 #define RESPAWN_CODE_BITS_ELEM_WIDTH 32
 
+#define STOP_STAGES_MAX              8
+
+// Listeners are passed to the target from this descriptor on, as sd_listen_fds() expects
+#define LISTEN_FDS_START             3
+#define LISTEN_FDS_MAX               64
+
+// Maximum length of the STATUS= text reported by a target, including the null byte
+#define NOTIFY_STATUS_MAX            128
+
+// Latency histograms split every power of two into 2^HISTOGRAM_SUB_BITS
+// buckets, a relative error of 1/16, and record up to UINT32_MAX microseconds
+#define HISTOGRAM_SUB_BITS           4
+#define HISTOGRAM_SUB_CNT            (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS            ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_CNT)
+
+// Number of successful probes the p99 of --restart-on-p99 is computed over
+#define HEALTH_LATENCY_WINDOW        100
+
+// Interval between two samples of the resource usage of a target
+#define RESOURCE_SAMPLE_MS           1000
+
+// RSS samples the growth trend is fitted over, and needed before it is trusted
+#define RSS_TREND_SAMPLES            300
+#define RSS_TREND_MIN_SAMPLES        30
+
+// Period of the quota written to cpu.max
+#define CGROUP_CPU_PERIOD_US         100000
+
+// Highest CPU or NUMA node number + 1 of a cpu_mask_t, as cpu_set_t
+#define CPU_MASK_BITS                1024
+
+// --cpus=auto, and --numa-node unset or auto
+#define CPUS_AUTO                    -1
+#define NUMA_NODE_NONE               -1
+#define NUMA_NODE_AUTO               -2
+
+// Shortest interval between two rebalancing rounds
+#define REBALANCE_MIN_MS             1000
+// Rounds an instance stays on a core after a move, so its caches pay off
+#define REBALANCE_HOLD_ROUNDS        3
+// Least load a move must take off the hottest core, in percent of a CPU
+#define REBALANCE_MIN_GAIN_PERCENT   10
+
+// Exit code used by the child process when execv() fails.
+// This is a reserved internal status code (254) to distinguish between
+// a failure in the supervisor's setup and the target program's own exit status.
+// Value 254 is used as it is rarely used by standard applications.
+#define CHILD_EXEC_ERR_CODE          254
+
+enum RESPAWN_BACKOFF
+{
+    RESPAWN_BACKOFF_FIXED,
+    RESPAWN_BACKOFF_EXP,
+};
+
+enum HEALTH_PROBE
+{
+    HEALTH_PROBE_NONE,
+    HEALTH_PROBE_CMD,
+    HEALTH_PROBE_TCP,
+    HEALTH_PROBE_UNIX,
+};
+
+enum KILL_MODE
+{
+    KILL_MODE_PROCESS, // the target only
+    KILL_MODE_GROUP,   // the process group of the target
+    KILL_MODE_CGROUP,  // every process in the cgroup of the target
+};
+
+// Scheduling policies of --sched
+enum SCHED_CLASS
+{
+    SCHED_CLASS_NONE,  // keep the policy of rund
+    SCHED_CLASS_FIFO,  // SCHED_FIFO, real-time
+    SCHED_CLASS_RR,    // SCHED_RR, real-time
+    SCHED_CLASS_BATCH, // SCHED_BATCH
+    SCHED_CLASS_IDLE,  // SCHED_IDLE
+};
+
+// IO scheduling classes of --ioclass, with the values of ioprio_set()
+enum IO_CLASS
+{
+    IO_CLASS_NONE, // keep the class of rund
+    IO_CLASS_RT,   // real-time
+    IO_CLASS_BE,   // best effort
+    IO_CLASS_IDLE, // idle
+};
+
+// --nice and --oom-score-adj not given
+#define PRIORITY_UNSET INT32_MIN
+
+// Resources --rlimit accepts, each set at most once
+#define RLIMIT_SPEC_MAX  5
+#define RLIMIT_UNLIMITED UINT64_MAX
+
+// A resource limit of the target, RLIMIT_UNLIMITED for no limit
+typedef struct
+{
+    int resource;
+    uint64_t soft;
+    uint64_t hard;
+} rlimit_spec_t;
+
+enum SPAWN_BACKEND
+{
+    SPAWN_BACKEND_FORK,
+    SPAWN_BACKEND_VFORK,
+    SPAWN_BACKEND_CLONE3,
+};
+
+// Spawn backend used unless overridden by --spawn, selected at build time
+#ifndef RUND_DEFAULT_SPAWN_BACKEND
+#define RUND_DEFAULT_SPAWN_BACKEND SPAWN_BACKEND_VFORK
+#endif
+
+typedef struct
+{
+    int signo;
+    // time to wait for the target to exit before the next stage, 0 for the last stage
+    uint64_t timeout_ms;
+} stop_stage_t;
+
+// Set of CPUs or NUMA nodes, laid out like cpu_set_t and the node masks of
+// set_mempolicy()
+typedef struct
+{
+    unsigned long bits[CPU_MASK_BITS / (8 * sizeof(unsigned long))];
+} cpu_mask_t;
+
+// USER, LOGNAME and HOME
+#define SPAWN_PLAN_USER_ENV_CNT 3
+
+// Part of the spawn plan specific to a replica
 typedef struct
 {
+    char **envp;
+    char *replica_env;
+    // LISTEN_PID= and WATCHDOG_PID=, filled in by the child, which is the
+    // only one knowing its pid
+    char listen_pid_env[32];
+    char watchdog_pid_env[32];
+
+    int stdout_fd;
+    int stderr_fd;
+
+    // O_PATH descriptors of the cgroups of both process slots of the
+    // instance, -1 unless the kill mode is cgroup
+    int cgroup_fds[2];
+
+    // CPUs the replica is pinned to, and NUMA node its memory is bound to,
+    // NUMA_NODE_NONE to keep the policy of rund
+    cpu_mask_t cpus;
+    bool pin_cpus;
+    int numa_node;
+    // core of the topology the replica is spread to, -1 unless --cpus=auto
+    int core;
+} spawn_replica_t;
+
+// Everything the child needs between fork and exec, resolved once at parse time
+typedef struct
+{
+    // environment shared by all replicas
+    char **envp;
+    char *user_env[SPAWN_PLAN_USER_ENV_CNT];
+
+    gid_t *groups;
+    int group_cnt;
+
+    // O_PATH descriptor of the target, -1 to execute it by path
+    int target_fd;
+
+    // listeners held across respawns, in the order of the --listen options
+    int *listen_fds;
+    int listen_fd_cnt;
+    char *listen_fds_env;
+
+    char *watchdog_usec_env;
+
+    // cgroup of the service and its O_PATH descriptor, -1 without --cgroup
+    char *cgroup_path;
+    int cgroup_fd;
+
+    spawn_replica_t *replicas;
+    int replica_cnt;
+} spawn_plan_t;
+
+#define SPAWN_PLAN_INITIALIZER {NULL, {NULL, NULL, NULL}, NULL, 0, -1, NULL, 0, NULL, NULL, NULL, -1, NULL, 0}
+
+typedef struct
+{
+    // service name from the config file, NULL on the command line
+    const char *name;
+
     char *stdout_file;
     char *stderr_file;
 
@@ -42,16 +261,118 @@ typedef struct
 
     bool respawn;
     uint32_t respawn_code_bits[RESPAWN_CODE_BITS_ARRAY_SIZE];
-    int respawn_delay;
+    // whether the default respawn codes were replaced by --respawn-code
+    bool respawn_code_set;
+    uint64_t respawn_delay_ms;
+    enum RESPAWN_BACKOFF respawn_backoff;
+    uint64_t respawn_max_delay_ms;
+    // percentage by which a respawn delay may be randomly shortened
+    int respawn_jitter;
+    // uptime after which the backoff starts over, 0 to never reset it
+    uint64_t respawn_reset_ms;
+    // at most respawn_limit_burst respawns within respawn_limit_window_ms, 0 for no limit
+    int respawn_limit_burst;
+    uint64_t respawn_limit_window_ms;
+    // pause after the limit is hit, 0 for the window
+    uint64_t respawn_cooldown_ms;
     int max_respawn_cnt;
 
+    int stop_signal;
+    uint64_t stop_timeout_ms;
+    stop_stage_t stop_stages[STOP_STAGES_MAX];
+    size_t stop_stage_cnt;
+    // processes the stop signals are sent to, and killed when the target exits
+    enum KILL_MODE kill_mode;
+
+    enum SPAWN_BACKEND spawn_backend;
+    bool exec_by_path;
+
+    // descriptor the target writes to when ready, -1 if it does not notify
+    int ready_fd;
+    // whether the target reports its state through NOTIFY_SOCKET
+    bool notify;
+    uint64_t ready_timeout_ms;
+    // maximum time between two keep-alives, 0 to disable the watchdog
+    uint64_t watchdog_ms;
+
+    enum HEALTH_PROBE health_probe;
+    // command or address given on the command line
+    char *health_arg;
+    // "/bin/sh -c COMMAND" for command probes
+    char *health_argv[4];
+    // address to connect to for socket probes
+    struct sockaddr_storage health_addr;
+    socklen_t health_addr_len;
+    uint64_t health_interval_ms;
+    uint64_t health_timeout_ms;
+    // consecutive failures after which the target is restarted
+    int health_retries;
+    // probe p99 latency over which the target is restarted, 0 to disable
+    uint64_t restart_p99_ms;
+
+    // resident set size over which the target is restarted, 0 to disable
+    uint64_t max_rss_bytes;
+    // CPU usage over a whole window over which the target is restarted, 0
+    // to disable, 100 is a full CPU
+    int max_cpu_percent;
+    uint64_t max_cpu_window_ms;
+    // recycle the target when its RSS trend reaches max_rss_bytes within
+    // this time, 0 to disable
+    uint64_t recycle_horizon_ms;
+
+    // parent of the cgroup of the service, NULL to stay in the cgroup of rund
+    char *cgroup_root;
+    // cgroup limits, 0 to keep the value of the cgroup
+    uint64_t memory_max_bytes;
+    uint64_t memory_high_bytes;
+    int cpu_max_percent;
+    int cpu_weight;
+    int io_weight;
+    int pids_max;
+
+    // CPUs the target is pinned to, cpu_cnt is 0 to keep the affinity of
+    // rund, CPUS_AUTO to spread the replicas over the cores
+    cpu_mask_t cpus;
+    int cpu_cnt;
+    // NUMA node the memory of the target is bound to, NUMA_NODE_NONE to keep
+    // the policy of rund, NUMA_NODE_AUTO to spread the replicas over the nodes
+    int numa_node;
+
+    // scheduling of the target, applied before switching user
+    int nice;
+    enum SCHED_CLASS sched_class;
+    int sched_priority;
+    enum IO_CLASS io_class;
+    int io_priority;
+    int oom_score_adj;
+    // resource limits, applied before switching user
+    rlimit_spec_t rlimits[RLIMIT_SPEC_MAX];
+    int rlimit_cnt;
+
+    // listener specs, opened once and passed to every process of the service
+    char **listens;
+    size_t listen_cnt;
+
+    int replica_cnt;
+    spawn_plan_t plan;
+
+    char *config_file;
+    char *control_file;
+    // adopt orphaned descendants of the targets and reap them
+    bool subreaper;
+    // interval of the CPU load rebalancing of --cpus=auto, 0 to disable,
+    // and most instances moved per round
+    uint64_t rebalance_ms;
+    int rebalance_moves;
+
     char *target;
     int target_argc;
     char **target_argv;
 } option_t;
 
 #define OPTION_INITIALIZER                         \
-    {NULL /* stdout_file */,                       \
+    {NULL /* name */,                              \
+     NULL /* stdout_file */,                       \
      NULL /* stderr_file */,                       \
      NULL /* working_dir */,                       \
      NULL /* user */,                              \
@@ -63,26 +384,449 @@ typedef struct
      NULL /* pid_file */,                          \
      false /* respawn */,                          \
      {-2U, -1U, -1U, -1U} /* respawn_code_bits */, \
-     3 /* respawn_delay */,                        \
+     false /* respawn_code_set */,                 \
+     3000 /* respawn_delay_ms */,                  \
+     RESPAWN_BACKOFF_FIXED /* respawn_backoff */,  \
+     60000 /* respawn_max_delay_ms */,             \
+     0 /* respawn_jitter */,                       \
+     60000 /* respawn_reset_ms */,                 \
+     0 /* respawn_limit_burst */,                  \
+     0 /* respawn_limit_window_ms */,              \
+     0 /* respawn_cooldown_ms */,                  \
      0 /* max_respawn_cnt */,                      \
+     SIGTERM /* stop_signal */,                    \
+     10000 /* stop_timeout_ms */,                  \
+     {{0, 0}} /* stop_stages */,                   \
+     0 /* stop_stage_cnt */,                       \
+     KILL_MODE_PROCESS /* kill_mode */,            \
+     RUND_DEFAULT_SPAWN_BACKEND /* spawn_backend */, \
+     false /* exec_by_path */,                     \
+     -1 /* ready_fd */,                            \
+     false /* notify */,                           \
+     30000 /* ready_timeout_ms */,                 \
+     0 /* watchdog_ms */,                          \
+     HEALTH_PROBE_NONE /* health_probe */,         \
+     NULL /* health_arg */,                        \
+     {NULL, NULL, NULL, NULL} /* health_argv */,   \
+     {0} /* health_addr */,                        \
+     0 /* health_addr_len */,                      \
+     10000 /* health_interval_ms */,               \
+     5000 /* health_timeout_ms */,                 \
+     3 /* health_retries */,                       \
+     0 /* restart_p99_ms */,                       \
+     0 /* max_rss_bytes */,                        \
+     0 /* max_cpu_percent */,                      \
+     0 /* max_cpu_window_ms */,                    \
+     0 /* recycle_horizon_ms */,                   \
+     NULL /* cgroup_root */,                       \
+     0 /* memory_max_bytes */,                     \
+     0 /* memory_high_bytes */,                    \
+     0 /* cpu_max_percent */,                      \
+     0 /* cpu_weight */,                           \
+     0 /* io_weight */,                            \
+     0 /* pids_max */,                             \
+     {{0}} /* cpus */,                             \
+     0 /* cpu_cnt */,                              \
+     NUMA_NODE_NONE /* numa_node */,               \
+     PRIORITY_UNSET /* nice */,                    \
+     SCHED_CLASS_NONE /* sched_class */,           \
+     0 /* sched_priority */,                       \
+     IO_CLASS_NONE /* io_class */,                 \
+     0 /* io_priority */,                          \
+     PRIORITY_UNSET /* oom_score_adj */,           \
+     {{0, 0, 0}} /* rlimits */,                    \
+     0 /* rlimit_cnt */,                           \
+     NULL /* listens */,                           \
+     0 /* listen_cnt */,                           \
+     1 /* replica_cnt */,                          \
+     SPAWN_PLAN_INITIALIZER /* plan */,            \
+     NULL /* config_file */,                       \
+     NULL /* control_file */,                      \
+     false /* subreaper */,                        \
+     0 /* rebalance_ms */,                         \
+     1 /* rebalance_moves */,                      \
      NULL /* target */,                            \
      0 /* target_argc */,                          \
      NULL /* target_argv */}
 
 void free_option(option_t *opt);
 int parse_option(int argc, char **argv, option_t *opt);
+int set_option(option_t *opt, const char *name, const char *value);
+int finalize_option(option_t *opt);
+
+typedef struct config_chunk_s config_chunk_t;
+
+// Services loaded from a config file
+typedef struct
+{
+    option_t *services;
+    int service_cnt;
+
+    // storage of the names and command lines referenced by the services
+    config_chunk_t *arena;
+} config_t;
+
+#define CONFIG_INITIALIZER {NULL, 0, NULL}
+
+int config_load(config_t *config, const char *file);
+void config_free(config_t *config);
 
 typedef struct
 {
-    int stdout_fd;
-    int stderr_fd;
     int pid_fd;
 } runtimefds_t;
 
-#define RUNTIMEFDS_INITIALIZER {-1, -1, -1}
+#define RUNTIMEFDS_INITIALIZER {-1}
 
 int daemonize(const char *pid_file);
 
+char *notify_socket_env(void);
+int notify_init(void);
+void notify_cleanup(void);
+
+int listen_check_spec(const char *spec);
+int listen_open(const char *spec);
+void listen_close(const char *spec, int fd);
+bool unix_socket_in_use(const char *path);
+
+void cpu_mask_set(cpu_mask_t *mask, int id);
+bool cpu_mask_isset(const cpu_mask_t *mask, int id);
+int cpu_mask_count(const cpu_mask_t *mask);
+int cpu_list_parse(const char *str, cpu_mask_t *mask);
+void cpu_list_format(const cpu_mask_t *mask, char *buf, size_t size);
+int affinity_plan_init(spawn_plan_t *plan, const option_t *opt);
+void affinity_cleanup(void);
+
+// CPU load of a process spread to a core, input of the rebalancing
+typedef struct
+{
+    spawn_replica_t *replica;
+    pid_t pid;
+    // CPU time used since the previous round
+    uint64_t cpu_us;
+    // false while the process settles after a move
+    bool movable;
+    // set when the process is moved
+    bool moved;
+    void *data;
+} affinity_load_t;
+
+int affinity_rebalance(affinity_load_t *loads, int cnt, int max_moves, uint64_t min_gain_us);
+
+int cgroup_create(spawn_plan_t *plan, const option_t *opt);
+void cgroup_remove(spawn_plan_t *plan);
+int cgroup_leaf_open(const spawn_plan_t *plan, int replica, int slot);
+void cgroup_leaf_close(const spawn_plan_t *plan, int replica, int slot, int fd);
+int cgroup_kill(int fd, int signo);
+int cgroup_events_open(int fd);
+int cgroup_populated(int events_fd);
+
+int spawn_plan_init(spawn_plan_t *plan, const option_t *opt);
+int spawn_plan_open(spawn_plan_t *plan, const option_t *opt);
+void spawn_plan_free(spawn_plan_t *plan, const option_t *opt);
+const char *spawn_backend_name(enum SPAWN_BACKEND backend);
+int spawn_backend_from_name(const char *name);
+pid_t spawn_process(const option_t *opt, int replica, int slot, const sigset_t *sigmask, int ready_fd, int *pidfd);
+pid_t spawn_command(const option_t *opt, int replica, const sigset_t *sigmask, char *const *argv, int *pidfd);
+
+typedef struct event_s event_t;
+typedef void (*event_handler_t)(event_t *ev, uint32_t events);
+
+struct event_s
+{
+    int fd;
+    event_handler_t handler;
+    void *data;
+};
+
+typedef struct event_timer_s event_timer_t;
+typedef void (*event_timer_handler_t)(event_timer_t *timer);
+
+struct event_timer_s
+{
+    uint64_t expire_ms;
+    size_t heap_idx;
+    bool active;
+
+    event_timer_handler_t handler;
+    void *data;
+};
+
+int event_loop_init(void);
+void event_loop_cleanup(void);
+int event_add(event_t *ev, uint32_t events);
+int event_mod(event_t *ev, uint32_t events);
+void event_del(event_t *ev);
+int event_loop_wait(int timeout_ms);
+
+uint64_t event_now_ms(void);
+uint64_t event_now_us(void);
+int event_timer_start(event_timer_t *timer, uint64_t delay_ms);
+void event_timer_stop(event_timer_t *timer);
+
+typedef struct proc_s proc_t;
+typedef void (*proc_exit_handler_t)(proc_t *proc, int status);
+// called for a reaped descendant that is not watched, with its session id,
+// -1 if unknown
+typedef void (*proc_stray_handler_t)(pid_t pid, pid_t sid, int status);
+
+struct proc_s
+{
+    pid_t pid;
+    int pidfd;
+    event_t event;
+
+    proc_exit_handler_t on_exit;
+    void *data;
+
+    proc_t *next;
+};
+
+int proc_watch(proc_t *proc, pid_t pid, int pidfd);
+void proc_unwatch(proc_t *proc);
+proc_t *proc_find(pid_t pid);
+void proc_reap(void);
+int proc_subreaper_init(proc_stray_handler_t on_stray);
+void proc_cleanup(void);
+
+typedef struct health_check_s health_check_t;
+typedef void (*health_result_handler_t)(health_check_t *check, bool ok, const char *reason);
+
+// A health probe of an instance, at most one in flight
+struct health_check_s
+{
+    const option_t *opt;
+    int replica;
+
+    bool running;
+    uint64_t started_us;
+    // round-trip time of the last probe, valid in on_result
+    uint64_t latency_us;
+
+    // connecting socket of a socket probe
+    event_t event;
+    // process of a command probe, pid is -1 when none runs, which may
+    // outlive a cancelled probe until it is reaped
+    proc_t proc;
+    bool cancelled;
+
+    event_timer_t timeout_timer;
+
+    health_result_handler_t on_result;
+    void *data;
+};
+
+int health_resolve(option_t *opt, const char *addr);
+void health_check_init(health_check_t *check, const option_t *opt, int replica);
+int health_check_run(health_check_t *check, const sigset_t *sigmask);
+void health_check_cancel(health_check_t *check);
+size_t health_check_proc_cnt(void);
+
+// Log-bucketed histogram of latencies in microseconds
+typedef struct
+{
+    uint32_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t max_us;
+} histogram_t;
+
+void histogram_reset(histogram_t *hist);
+void histogram_record(histogram_t *hist, uint64_t us);
+uint64_t histogram_percentile(const histogram_t *hist, double percentile);
+
+// Reads the resource usage of a process from an open proc file
+typedef struct
+{
+    int fd;
+    // whether fd is /proc/PID/stat, with the CPU time, or /proc/PID/statm
+    bool cpu;
+} resource_sampler_t;
+
+int resource_sampler_open(resource_sampler_t *sampler, pid_t pid, bool cpu);
+int resource_sampler_read(resource_sampler_t *sampler, uint64_t *rss_bytes, uint64_t *cpu_us);
+void resource_sampler_close(resource_sampler_t *sampler);
+
+typedef struct
+{
+    uint64_t ms;
+    uint64_t bytes;
+} rss_sample_t;
+
+// Last RSS samples of a process, ring buffer of RSS_TREND_SAMPLES entries
+typedef struct
+{
+    rss_sample_t *samples;
+    int head;
+    int cnt;
+} rss_trend_t;
+
+void rss_trend_reset(rss_trend_t *trend);
+void rss_trend_add(rss_trend_t *trend, uint64_t ms, uint64_t bytes);
+int rss_trend_eta(const rss_trend_t *trend, uint64_t limit_bytes, uint64_t *eta_ms, double *bytes_per_s);
+
+enum INSTANCE_STATE
+{
+    INSTANCE_STATE_IDLE,     // not started yet
+    INSTANCE_STATE_RUNNING,  // target is running
+    INSTANCE_STATE_STOPPING, // stop sequence in progress
+    INSTANCE_STATE_WAITING,  // waiting to respawn
+    INSTANCE_STATE_DONE,     // stopped for good
+};
+
+// Circuit breaker of the respawn rate limit
+enum RESPAWN_BREAKER
+{
+    RESPAWN_BREAKER_CLOSED,    // respawning normally
+    RESPAWN_BREAKER_OPEN,      // limit hit, respawning suspended until the cooldown ends
+    RESPAWN_BREAKER_HALF_OPEN, // trial respawn, closed if it runs for a whole window
+};
+
+typedef struct service_s service_t;
+typedef struct instance_s instance_t;
+
+// A process of an instance
+typedef struct
+{
+    instance_t *inst;
+
+    // pid is -1 when no process runs in this slot
+    proc_t proc;
+    uint64_t started_ms;
+
+    // read end of the readiness pipe, fd is -1 when not waiting for readiness
+    event_t ready_event;
+    bool ready;
+    // time from exec to the last readiness report
+    uint64_t ready_after_ms;
+
+    // state reported through NOTIFY_SOCKET, main_pid is 0 until MAINPID=
+    pid_t main_pid;
+    bool reloading;
+    uint64_t reload_started_ms;
+    char status[NOTIFY_STATUS_MAX];
+
+    // keep-alive deadline, only moved forward when it expires, so that a
+    // keep-alive just records its time
+    event_timer_t watchdog_timer;
+    uint64_t watchdog_ms;
+    // stopped by the watchdog, a failing health probe or a resource limit,
+    // respawned whatever its exit status
+    bool unhealthy;
+
+    // resource usage, fd of the sampler is -1 when not sampled
+    resource_sampler_t sampler;
+    uint64_t rss_bytes;
+    // CPU time at the start of the current window, and usage over the last
+    // whole window, -1 until the first one ends
+    uint64_t cpu_window_started_ms;
+    uint64_t cpu_window_start_us;
+    int cpu_percent;
+
+    // stop escalation, or readiness deadline of a replacement
+    event_timer_t timer;
+    bool stopping;
+    size_t stop_stage;
+    uint64_t stop_started_ms;
+
+    // cgroup.events of the slot, fd is -1 unless the target exited and
+    // the rest of its cgroup is being killed; the exit is handled once the
+    // cgroup is empty
+    event_t cgroup_event;
+    // last process of the slot that exited, and its status
+    pid_t exit_pid;
+    int exit_status;
+} instance_proc_t;
+
+// A replica of a service and the state of its current process
+struct instance_s
+{
+    service_t *svc;
+    int index;
+    // name used in log messages
+    char *name;
+
+    enum INSTANCE_STATE state;
+
+    // the current process, and during a restart its replacement or the
+    // previous process being stopped
+    instance_proc_t procs[2];
+    int cur;
+    // whether the other slot holds a replacement waiting to be ready
+    bool restarting;
+
+    unsigned int respawn_cnt;
+    // number of delay doublings of the exponential backoff
+    unsigned int backoff_level;
+
+    // times of the last respawns, ring buffer of respawn_limit_burst entries
+    uint64_t *respawn_ring;
+    int respawn_ring_head;
+    int respawn_ring_cnt;
+    enum RESPAWN_BREAKER breaker;
+
+    // respawn delay or end of the breaker trial, depending on the state
+    event_timer_t timer;
+
+    // health probes of the current process, next probe time on health_timer
+    health_check_t health;
+    event_timer_t health_timer;
+    int health_failures;
+    // latencies of the last successful probes of the current process
+    histogram_t latency_window;
+
+    // next sample of the resource usage of the current process
+    event_timer_t resource_timer;
+    // RSS samples of the current process, samples is NULL without
+    // recycle_horizon_ms
+    rss_trend_t rss_trend;
+
+    // orphaned descendants reaped as subreaper
+    uint64_t stray_cnt;
+
+    // CPU time of the current process at the previous rebalancing round,
+    // balance_pid is the process it was sampled from
+    pid_t balance_pid;
+    uint64_t balance_cpu_us;
+    // last move to another core
+    uint64_t balance_moved_ms;
+    unsigned int migration_cnt;
+};
+
+struct service_s
+{
+    option_t *opt;
+    // service name from the config file, or the target
+    const char *name;
+
+    instance_t *instances;
+    int instance_cnt;
+    // stopped for good after its target failed to spawn, or on shutdown
+    bool stopped;
+
+    // latencies of the successful probes of every instance, since start
+    histogram_t latency;
+    uint64_t probe_failures;
+};
+
+int supervisor_init(const sigset_t *sigmask);
+void supervisor_rebalance_init(uint64_t interval_ms, int max_moves);
+int supervisor_add_service(option_t *opt);
+void supervisor_start(void);
+void supervisor_shutdown(void);
+void supervisor_signal_all(int sig);
+void supervisor_log_status(void);
+void supervisor_write_status(FILE *stream);
+void supervisor_write_latency(FILE *stream);
+void supervisor_stray_exited(pid_t pid, pid_t sid, int status);
+int supervisor_restart(const char *name);
+void supervisor_notify(pid_t pid, char *msg);
+bool supervisor_finished(void);
+int supervisor_exit_code(void);
+void supervisor_cleanup(void);
+
+int control_init(const char *file);
+void control_cleanup(void);
+
 enum LOG_LEVEL
 {
     LOG_LEVEL_DEBUG,
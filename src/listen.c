@@ -0,0 +1,316 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file listen.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ * 2026-10-16   Frank <uuidxx@163.com>          keep unix sockets still in use
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+// Prefixes of the listener specs
+#define LISTEN_PREFIX_TCP  "tcp:"
+#define LISTEN_PREFIX_UDP  "udp:"
+#define LISTEN_PREFIX_UNIX "unix:"
+
+/**
+ * @brief Check the syntax of a listener spec
+ *
+ * @param spec listener spec: tcp:[HOST:]PORT, udp:[HOST:]PORT or unix:PATH
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` invalid
+ */
+int listen_check_spec(const char *spec)
+{
+    const char *addr = NULL;
+
+    if (strncmp(spec, LISTEN_PREFIX_TCP, strlen(LISTEN_PREFIX_TCP)) == 0)
+    {
+        addr = spec + strlen(LISTEN_PREFIX_TCP);
+    }
+    else if (strncmp(spec, LISTEN_PREFIX_UDP, strlen(LISTEN_PREFIX_UDP)) == 0)
+    {
+        addr = spec + strlen(LISTEN_PREFIX_UDP);
+    }
+    else if (strncmp(spec, LISTEN_PREFIX_UNIX, strlen(LISTEN_PREFIX_UNIX)) == 0)
+    {
+        addr = spec + strlen(LISTEN_PREFIX_UNIX);
+        if (*addr == '\0' || strlen(addr) >= sizeof(((struct sockaddr_un *)NULL)->sun_path))
+        {
+            log_error("failed to parse listener '%s': invalid path", spec);
+            return -1;
+        }
+
+        return 0;
+    }
+    else
+    {
+        log_error("failed to parse listener '%s': expected tcp:, udp: or unix:", spec);
+        return -1;
+    }
+
+    const char *port = strrchr(addr, ':');
+    port = port ? port + 1 : addr;
+
+    if (*port == '\0')
+    {
+        log_error("failed to parse listener '%s': missing port", spec);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Open an inet listener
+ *
+ * @param spec listener spec, for log messages
+ * @param addr address part of the spec: [HOST:]PORT, HOST may be in brackets
+ * @param type SOCK_STREAM or SOCK_DGRAM
+ * @return int
+ * @retval `fd` socket descriptor
+ * @retval `-1` failed
+ */
+static int listen_inet(const char *spec, const char *addr, int type)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = type,
+        .ai_flags = AI_PASSIVE | AI_NUMERICSERV,
+    };
+    struct addrinfo *res = NULL;
+    char host[NI_MAXHOST];
+    const char *port = strrchr(addr, ':');
+    const char *node = NULL;
+
+    if (port)
+    {
+        size_t len = port - addr;
+
+        if (len >= 2 && addr[0] == '[' && addr[len - 1] == ']')
+        {
+            addr++;
+            len -= 2;
+        }
+
+        if (len >= sizeof(host))
+        {
+            log_error("failed to resolve %s: %s", spec, strerror(ENAMETOOLONG));
+            return -1;
+        }
+
+        memcpy(host, addr, len);
+        host[len] = '\0';
+        port++;
+
+        // empty or "*" listens on all addresses
+        if (len > 0 && strcmp(host, "*") != 0)
+        {
+            node = host;
+        }
+    }
+    else
+    {
+        port = addr;
+    }
+
+    int rc = getaddrinfo(node, port, &hints, &res);
+    if (rc != 0)
+    {
+        log_error("failed to resolve %s: %s", spec, gai_strerror(rc));
+        return -1;
+    }
+
+    int fd = -1;
+    int err = 0;
+
+    // listen on the first address that works, IPv6 first for the wildcard
+    for (int pass = 0; pass < 2 && fd < 0; pass++)
+    {
+        for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next)
+        {
+            if ((pass == 0) != (ai->ai_family == AF_INET6))
+            {
+                continue;
+            }
+
+            fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0)
+            {
+                err = errno;
+                continue;
+            }
+
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 ||
+                (type == SOCK_STREAM && listen(fd, SOMAXCONN) < 0))
+            {
+                err = errno;
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    freeaddrinfo(res);
+
+    if (fd < 0)
+    {
+        log_error("failed to listen on %s: %s", spec, strerror(err));
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Check whether a unix socket still accepts connections
+ *
+ * @param path socket path
+ * @return bool
+ */
+bool unix_socket_in_use(const char *path)
+{
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX,
+    };
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool in_use = connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) == 0;
+
+    close(fd);
+
+    return in_use;
+}
+
+/**
+ * @brief Open a unix stream listener
+ *
+ * A socket file left by a previous run is replaced, one still accepting
+ * connections is not. The socket is writable by everyone, access is meant
+ * to be restricted by its directory.
+ *
+ * @param spec listener spec, for log messages
+ * @param path socket path
+ * @return int
+ * @retval `fd` socket descriptor
+ * @retval `-1` failed
+ */
+static int listen_unix(const char *spec, const char *path)
+{
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX,
+    };
+    struct stat st;
+
+    strcpy(addr.sun_path, path);
+
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        if (unix_socket_in_use(path))
+        {
+            log_error("failed to listen on %s: %s", spec, strerror(EADDRINUSE));
+            return -1;
+        }
+
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        log_error("failed to create socket: %s", strerror(errno));
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        log_error("failed to listen on %s: %s", spec, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    chmod(path, 0666);
+
+    if (listen(fd, SOMAXCONN) < 0)
+    {
+        log_error("failed to listen on %s: %s", spec, strerror(errno));
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Open a listener
+ *
+ * The socket is close-on-exec, it is moved to its place in the child.
+ *
+ * @param spec listener spec, checked by listen_check_spec()
+ * @return int
+ * @retval `fd` socket descriptor
+ * @retval `-1` failed
+ */
+int listen_open(const char *spec)
+{
+    if (strncmp(spec, LISTEN_PREFIX_TCP, strlen(LISTEN_PREFIX_TCP)) == 0)
+    {
+        return listen_inet(spec, spec + strlen(LISTEN_PREFIX_TCP), SOCK_STREAM);
+    }
+
+    if (strncmp(spec, LISTEN_PREFIX_UDP, strlen(LISTEN_PREFIX_UDP)) == 0)
+    {
+        return listen_inet(spec, spec + strlen(LISTEN_PREFIX_UDP), SOCK_DGRAM);
+    }
+
+    return listen_unix(spec, spec + strlen(LISTEN_PREFIX_UNIX));
+}
+
+/**
+ * @brief Close a listener, and remove the socket file of a unix listener
+ *
+ * @param spec listener spec
+ * @param fd socket descriptor
+ */
+void listen_close(const char *spec, int fd)
+{
+    close(fd);
+
+    if (strncmp(spec, LISTEN_PREFIX_UNIX, strlen(LISTEN_PREFIX_UNIX)) == 0)
+    {
+        unlink(spec + strlen(LISTEN_PREFIX_UNIX));
+    }
+}
@@ -9,62 +9,44 @@
  * Date         Author                          Notes
  * 2025-12-19   Frank <uuidxx@163.com>          the first version
  * 2025-12-25   Frank <uuidxx@163.com>          add support for running user
+ * 2026-10-15   Frank <uuidxx@163.com>          replace sigsuspend loop with epoll and pidfd
+ * 2026-10-15   Frank <uuidxx@163.com>          handle signals through signalfd
+ * 2026-10-15   Frank <uuidxx@163.com>          event driven graceful shutdown with signal escalation
+ * 2026-10-15   Frank <uuidxx@163.com>          move child setup to spawn backends
+ * 2026-10-15   Frank <uuidxx@163.com>          move process management to the supervisor
+ * 2026-10-15   Frank <uuidxx@163.com>          supervise the services of a config file
+ * 2026-10-15   Frank <uuidxx@163.com>          log status on SIGUSR1
+ * 2026-10-15   Frank <uuidxx@163.com>          listen for commands on the control socket
+ * 2026-10-15   Frank <uuidxx@163.com>          watch the notify socket
+ * 2026-10-15   Frank <uuidxx@163.com>          become child subreaper
+ * 2026-10-16   Frank <uuidxx@163.com>          release the CPU topology
+ * 2026-10-16   Frank <uuidxx@163.com>          enable CPU load rebalancing
  *
  */
 
 #include <errno.h>
-#include <fcntl.h>
-#include <grp.h>
 #include <libgen.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
-#include <sys/wait.h>
-#include <syslog.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
 
 #include "internal.h"
 
-// Exit code used by the child process when execv() fails.
-// This is a reserved internal status code (254) to distinguish between
-// a failure in the supervisor's setup and the target program's own exit status.
-// Value 254 is used as it is rarely used by standard applications.
-#define CHILD_EXEC_ERR_CODE 254
-
 static option_t option = OPTION_INITIALIZER;
+static config_t config = CONFIG_INITIALIZER;
 static runtimefds_t runtimefds = RUNTIMEFDS_INITIALIZER;
 
-static volatile sig_atomic_t shutdown_requested = 0;
+// Maximum number of signals drained by a single read() on the signalfd
+#define SIGNAL_BATCH_SIZE 16
 
-/**
- * @brief Check if the target process should be respawned based on exit code
- *
- * @param opt option
- * @param code exit code of the terminated target process
- * @return bool
- * @retval `true` target should be respawned
- * @retval `false` target should not be respawned
- */
-static bool check_respawn_required(const option_t *opt, int code)
-{
-    if (!opt->respawn)
-    {
-        return false;
-    }
+static bool shutdown_requested = false;
 
-    for (int i = 0; i < RESPAWN_CODE_BITS_ARRAY_SIZE; i++)
-    {
-        if (code < RESPAWN_CODE_BITS_ELEM_WIDTH)
-        {
-            return opt->respawn_code_bits[i] & (1 << code);
-        }
-
-        code -= RESPAWN_CODE_BITS_ELEM_WIDTH;
-    }
-
-    return false;
-}
+// signals handled by the supervisor, blocked and read from signalfd
+static sigset_t signal_mask;
+static event_t signal_event = {.fd = -1};
 
 /**
  * @brief Clean up resources and terminate the process
@@ -73,18 +55,6 @@ static bool check_respawn_required(const option_t *opt, int code)
  */
 static void cleanup_and_exit(int code)
 {
-    if (runtimefds.stdout_fd >= 0)
-    {
-        close(runtimefds.stdout_fd);
-        runtimefds.stdout_fd = -1;
-    }
-
-    if (runtimefds.stderr_fd >= 0)
-    {
-        close(runtimefds.stderr_fd);
-        runtimefds.stderr_fd = -1;
-    }
-
     if (runtimefds.pid_fd >= 0)
     {
         close(runtimefds.pid_fd);
@@ -93,204 +63,159 @@ static void cleanup_and_exit(int code)
         unlink(option.pid_file);
     }
 
+    if (signal_event.fd >= 0)
+    {
+        close(signal_event.fd);
+        signal_event.fd = -1;
+    }
+
+    control_cleanup();
+    notify_cleanup();
+    supervisor_cleanup();
+    proc_cleanup();
+    event_loop_cleanup();
+
+    config_free(&config);
     free_option(&option);
+    affinity_cleanup();
 
     exit(code);
 }
 
 /**
- * @brief Redirect standard file descriptors (stdin, stdout, stderr)
+ * @brief Handle pending signals read from the signalfd
+ *
+ * All queued signals are drained in one batch and coalesced, so a burst of
+ * signals costs a single wakeup and is acted upon once. Runs in the normal
+ * context of the event loop, so logging is safe here.
  *
- * @param opt option
- * @param fds standard file descriptor
+ * @param ev event
+ * @param events ready events
  */
-static void redirect_std_fds(const option_t *opt, runtimefds_t *fds)
+static void signal_handler(event_t *ev, uint32_t events)
 {
-    if (option.stdout_file)
-    {
-        fds->stdout_fd = open(option.stdout_file, O_WRONLY | O_CREAT | O_APPEND, 0644);
-        if (fds->stdout_fd >= 0)
-        {
-            dup2(fds->stdout_fd, STDOUT_FILENO);
-        }
-        else
-        {
-            log_error("failed to open %s: %s", option.stdout_file, strerror(errno));
-        }
-    }
+    struct signalfd_siginfo infos[SIGNAL_BATCH_SIZE];
+    int shutdown_sig = 0;
+    unsigned int shutdown_cnt = 0;
+    bool child_signaled = false;
+    bool reload_requested = false;
+    bool status_requested = false;
 
-    if (option.stderr_file)
+    while (1)
     {
-        fds->stderr_fd = open(option.stderr_file, O_WRONLY | O_CREAT | O_APPEND, 0644);
-        if (fds->stderr_fd >= 0)
+        ssize_t len = read(ev->fd, infos, sizeof(infos));
+        if (len < 0)
         {
-            dup2(fds->stderr_fd, STDERR_FILENO);
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno != EAGAIN)
+            {
+                log_error("failed to read signalfd: %s", strerror(errno));
+            }
+
+            break;
         }
-        else
+
+        for (size_t i = 0; i < (size_t)len / sizeof(infos[0]); i++)
         {
-            log_error("failed to open %s: %s", option.stderr_file, strerror(errno));
-        }
-    }
-}
+            switch (infos[i].ssi_signo)
+            {
+            case SIGINT:
+            case SIGTERM:
+                if (!shutdown_sig)
+                {
+                    shutdown_sig = infos[i].ssi_signo;
+                }
+                shutdown_cnt++;
+                break;
 
-/**
- * @brief Set user and group
- *
- * @param opt option
- * @return int
- * @retval `0` ok
- * @retval `-1` failed
- */
-static int set_user_and_group(const option_t *opt)
-{
-    if (!opt->user)
-    {
-        return 0;
-    }
+            case SIGCHLD:
+                child_signaled = true;
+                break;
 
-    int rc;
+            case SIGHUP:
+                reload_requested = true;
+                break;
 
-    rc = initgroups(opt->user, opt->gid);
-    if (rc < 0)
-    {
-        log_error("failed to init groups: %s", strerror(errno));
-        return -1;
-    }
+            case SIGUSR1:
+                status_requested = true;
+                break;
 
-    rc = setgid(opt->gid);
-    if (rc < 0)
-    {
-        log_error("failed to switch group: %s", strerror(errno));
-        return -1;
+            default:
+                break;
+            }
+        }
+
+        if ((size_t)len < sizeof(infos))
+        {
+            break;
+        }
     }
 
-    rc = setuid(opt->uid);
-    if (rc < 0)
+    if (child_signaled)
     {
-        log_error("failed to switch user: %s", strerror(errno));
-        return -1;
+        // child exited, reaped here when pidfd is unavailable or as subreaper
+        proc_reap();
     }
 
-    setenv("USER", opt->user, 1);
-    setenv("LOGNAME", opt->user, 1);
-    setenv("HOME", opt->home_dir, 1);
-
-    return 0;
-}
-
-/**
- * @brief Set the environments
- *
- * @param opt option
- */
-static void set_environments(const option_t *opt)
-{
-    for (int i = 0; i < opt->environment_cnt; i++)
+    if (reload_requested)
     {
-        putenv(opt->environments[i]);
+        supervisor_signal_all(SIGHUP);
     }
-}
 
-/**
- * @brief Gracefully shut down the target process
- *
- * Attempts to terminate the target process gracefully by sending signals.
- * First sends SIGTERM, and if the process doesn't exit within the grace period,
- * sends SIGKILL as a last resort.
- *
- * @param pid process ID of the target to shut down
- * @param opt option
- */
-static void graceful_shutdown(pid_t pid, const option_t *opt)
-{
-    if (pid <= 0)
+    if (status_requested)
     {
-        return;
+        supervisor_log_status();
     }
 
-    int rc;
-    // 10 seconds
-    // *improve: make it configurable
-    int timeout_cnt = 5 * 10;
-
-    // send SIGTERM first
-    kill(pid, SIGTERM);
-
-    while (timeout_cnt > 0)
+    if (shutdown_sig && !shutdown_requested)
     {
-        usleep(200 * 1000);
-        rc = waitpid(pid, NULL, WNOHANG);
-        if (rc == pid)
+        log_warn("shutdown signal received: %s (%d)", strsignal(shutdown_sig), shutdown_sig);
+        if (shutdown_cnt > 1)
         {
-            return;
+            log_warn("%u shutdown signals coalesced", shutdown_cnt);
         }
 
-        timeout_cnt--;
+        shutdown_requested = true;
+        supervisor_shutdown();
     }
-
-    // timed out and force to kill
-    log_warn("waiting for %s to exit timed out; force terminating it", opt->target);
-    kill(pid, SIGKILL);
-
-    waitpid(pid, NULL, 0);
 }
 
 /**
- * @brief Signal handler for process management
+ * @brief Initialize signal handling
  *
- * @param sig signal number received
- */
-static void sigaction_handler(int sig)
-{
-    switch (sig)
-    {
-    case SIGINT:
-    case SIGTERM:
-        log_warn("shutdown signal received: %s (%d)", strsignal(sig), sig);
-        shutdown_requested = 1;
-
-        break;
-
-    case SIGCHLD:
-        // child exited
-        break;
-
-    default:
-        break;
-    }
-}
-
-/**
- * @brief Initialize signal handlers
+ * Handled signals are blocked and routed to a signalfd watched by the event
+ * loop, so no code runs in signal context.
  *
+ * @param oldmask buffer to store the previous signal mask, restored in the child
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
  */
-static void sigaction_init(void)
+static int signal_init(sigset_t *oldmask)
 {
-    struct sigaction sa;
-
-    sa.sa_handler = sigaction_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&signal_mask);
+    sigaddset(&signal_mask, SIGCHLD);
+    sigaddset(&signal_mask, SIGTERM);
+    sigaddset(&signal_mask, SIGINT);
+    sigaddset(&signal_mask, SIGHUP);
+    sigaddset(&signal_mask, SIGUSR1);
 
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTERM, &sa, NULL);
-    sigaction(SIGCHLD, &sa, NULL);
-}
+    sigprocmask(SIG_BLOCK, &signal_mask, oldmask);
 
-/**
- * @brief Reset signal handler
- *
- */
-static void reset_sigaction(void)
-{
-    struct sigaction sa;
+    signal_event.fd = signalfd(-1, &signal_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_event.fd < 0)
+    {
+        log_error("failed to create signalfd: %s", strerror(errno));
+        return -1;
+    }
 
-    sa.sa_handler = SIG_DFL;
-    sigemptyset(&sa.sa_mask);
+    signal_event.handler = signal_handler;
 
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTERM, &sa, NULL);
-    sigaction(SIGCHLD, &sa, NULL);
+    return event_add(&signal_event, EPOLLIN);
 }
 
 int main(int argc, char **argv)
@@ -315,6 +240,15 @@ int main(int argc, char **argv)
         break;
     }
 
+    if (option.config_file)
+    {
+        rc = config_load(&config, option.config_file);
+        if (rc < 0)
+        {
+            cleanup_and_exit(EXIT_FAILURE);
+        }
+    }
+
     rc = daemonize(option.pid_file);
     if (rc < 0)
     {
@@ -325,165 +259,94 @@ int main(int argc, char **argv)
         runtimefds.pid_fd = rc;
     }
 
-    pid_t pid;
-    int status;
-    bool respawn_required;
-    unsigned int respawn_cnt = 0;
+    sigset_t oldmask;
 
-    sigset_t mask, oldmask;
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGCHLD);
-    sigaddset(&mask, SIGTERM);
-    sigaddset(&mask, SIGINT);
+    rc = event_loop_init();
+    if (rc < 0)
+    {
+        cleanup_and_exit(EXIT_FAILURE);
+    }
 
-    sigaction_init();
+    rc = signal_init(&oldmask);
+    if (rc < 0)
+    {
+        cleanup_and_exit(EXIT_FAILURE);
+    }
 
-    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+    supervisor_init(&oldmask);
 
-    while (1)
+    if (option.subreaper)
     {
-        pid = fork();
-        if (pid < 0)
+        rc = proc_subreaper_init(supervisor_stray_exited);
+        if (rc < 0)
         {
-            log_error("failed to fork: %s", strerror(errno));
-            log_error("%s exited", prog_name);
             cleanup_and_exit(EXIT_FAILURE);
         }
-        else if (pid == 0)
-        {
-            // here is child process
-
-            sigprocmask(SIG_SETMASK, &oldmask, NULL);
-            reset_sigaction();
-            if (runtimefds.pid_fd >= 0)
-            {
-                close(runtimefds.pid_fd);
-            }
-
-            setsid();
-            umask(022);
-
-            if (option.working_dir)
-            {
-                chdir(option.working_dir);
-            }
+    }
 
-            set_environments(&option);
+    if (option.rebalance_ms > 0)
+    {
+        supervisor_rebalance_init(option.rebalance_ms, option.rebalance_moves);
+    }
 
-            redirect_std_fds(&option, &runtimefds);
+    rc = notify_init();
+    if (rc < 0)
+    {
+        cleanup_and_exit(EXIT_FAILURE);
+    }
 
-            // switch user
-            rc = set_user_and_group(&option);
+    if (option.config_file)
+    {
+        for (int i = 0; i < config.service_cnt; i++)
+        {
+            rc = supervisor_add_service(&config.services[i]);
             if (rc < 0)
             {
-                _exit(CHILD_EXEC_ERR_CODE);
+                cleanup_and_exit(EXIT_FAILURE);
             }
-
-            log_info("start to execute %s", option.target);
-
-            execv(option.target, option.target_argv);
-
-            _exit(CHILD_EXEC_ERR_CODE);
         }
 
-        // here is parent process
-
-        while (1)
+        log_info("loaded %d services from %s", config.service_cnt, option.config_file);
+    }
+    else
+    {
+        rc = supervisor_add_service(&option);
+        if (rc < 0)
         {
-            if (shutdown_requested)
-            {
-                log_info("graceful shutdown %s", option.target);
-
-                graceful_shutdown(pid, &option);
-
-                log_info("%s exited", prog_name);
-                cleanup_and_exit(EXIT_SUCCESS);
-            }
-
-            // wait for child process to exit
-            rc = waitpid(pid, &status, WNOHANG);
-
-            if (rc == pid)
-            {
-                respawn_required = option.respawn;
-
-                // check the exit status of the child process
-                if (WIFEXITED(status))
-                {
-                    // check if execution failed
-                    if (WEXITSTATUS(status) == CHILD_EXEC_ERR_CODE)
-                    {
-                        log_error("failed to execute %s", option.target);
-                        log_error("%s exited", prog_name);
-                        cleanup_and_exit(EXIT_FAILURE);
-                    }
-
-                    // child exited normally
-                    // check if respawn is needed
-                    log_warn("%s exited, status: %d", option.target, WEXITSTATUS(status));
-                    respawn_required = check_respawn_required(&option, WEXITSTATUS(status));
-                }
-                else if (WIFSIGNALED(status))
-                {
-                    // child terminated by a signal
-                    log_warn("%s exited, signal: %s (%d)", option.target, strsignal(WTERMSIG(status)), WTERMSIG(status));
-                }
-                else
-                {
-                    // child exited abnormally without a clear signal or exit status
-                    log_warn("%s exited abnormal", option.target);
-                }
-
-                // increment respawn counter and check against the configured maximum
-                respawn_cnt++;
-                if (option.max_respawn_cnt && respawn_cnt > option.max_respawn_cnt)
-                {
-                    log_info("maximum respawn attempts reached for %s", option.target);
-                    log_info("%s exited", prog_name);
-                    cleanup_and_exit(EXIT_SUCCESS);
-                }
-
-                // exit if respawning is not required
-                if (!respawn_required)
-                {
-                    log_info("%s exited", prog_name);
-                    cleanup_and_exit(EXIT_SUCCESS);
-                }
+            cleanup_and_exit(EXIT_FAILURE);
+        }
+    }
 
-                if (option.respawn_delay > 0)
-                {
-                    log_info("%s respawning in %d seconds", option.target, option.respawn_delay);
-
-                    sigset_t wait_mask;
-                    sigemptyset(&wait_mask);
-                    sigaddset(&wait_mask, SIGTERM);
-                    sigaddset(&wait_mask, SIGINT);
-
-                    struct timespec timeout;
-                    timeout.tv_sec = option.respawn_delay;
-                    timeout.tv_nsec = 0;
-
-                    int sig = sigtimedwait(&wait_mask, NULL, &timeout);
-                    if (sig == SIGTERM || sig == SIGINT)
-                    {
-                        log_warn("shutdown signal received: %s (%d)", strsignal(sig), sig);
-                        log_info("%s exited", prog_name);
-                        cleanup_and_exit(EXIT_SUCCESS);
-                    }
-                }
-                else
-                {
-                    log_info("%s respawning immediately", option.target);
-                }
+    if (option.control_file)
+    {
+        rc = control_init(option.control_file);
+        if (rc < 0)
+        {
+            cleanup_and_exit(EXIT_FAILURE);
+        }
+    }
 
-                // exit the loop to respawn the child process
-                break;
-            }
+    supervisor_start();
 
-            sigsuspend(&oldmask);
+    while (!supervisor_finished())
+    {
+        rc = event_loop_wait(-1);
+        if (rc < 0 && errno != EINTR)
+        {
+            log_error("%s exited", prog_name);
+            cleanup_and_exit(EXIT_FAILURE);
         }
     }
 
-    log_info("%s exited", prog_name);
-    cleanup_and_exit(EXIT_SUCCESS);
+    rc = supervisor_exit_code();
+    if (rc == EXIT_SUCCESS)
+    {
+        log_info("%s exited", prog_name);
+    }
+    else
+    {
+        log_error("%s exited", prog_name);
+    }
+
+    cleanup_and_exit(rc);
 }
@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file notify.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+// Maximum size of a notification message
+#define NOTIFY_MSG_MAX 4096
+
+// Maximum number of descriptors accepted along with a message
+#define NOTIFY_FDS_MAX 16
+
+static event_t notify_event = {.fd = -1};
+
+// NOTIFY_SOCKET= entry of the target environment
+static char *notify_env = NULL;
+
+/**
+ * @brief Get the NOTIFY_SOCKET entry of the target environment
+ *
+ * The socket is created on first use, with an abstract address chosen by the
+ * kernel, so it needs neither a path nor a cleanup and cannot collide with
+ * another rund. Credentials are attached to every message, to tell which
+ * process sent it.
+ *
+ * @return char*
+ * @retval `entry` NOTIFY_SOCKET=@ADDRESS
+ * @retval `NULL` failed
+ */
+char *notify_socket_env(void)
+{
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX,
+    };
+    socklen_t addr_len = sizeof(addr);
+    int on = 1;
+
+    if (notify_env)
+    {
+        return notify_env;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        log_error("failed to create socket: %s", strerror(errno));
+        return NULL;
+    }
+
+    if (setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)) < 0)
+    {
+        log_error("failed to enable SO_PASSCRED: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    // binding only the address family autobinds to a unique abstract address
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(sa_family_t)) < 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &addr_len) < 0)
+    {
+        log_error("failed to bind notify socket: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    // abstract addresses start with a null byte, written as '@'
+    int name_len = addr_len - offsetof(struct sockaddr_un, sun_path) - 1;
+    if (asprintf(&notify_env, "NOTIFY_SOCKET=@%.*s", name_len, addr.sun_path + 1) < 0)
+    {
+        notify_env = NULL;
+        log_error("failed to asprintf: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    notify_event.fd = fd;
+
+    return notify_env;
+}
+
+/**
+ * @brief Close the descriptors passed along with a message
+ *
+ * @param cmsg control message carrying SCM_RIGHTS
+ */
+static void close_passed_fds(struct cmsghdr *cmsg)
+{
+    int *fds = (int *)CMSG_DATA(cmsg);
+    size_t cnt = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+    for (size_t i = 0; i < cnt; i++)
+    {
+        close(fds[i]);
+    }
+}
+
+/**
+ * @brief Read the pending notification messages
+ *
+ * Messages without credentials or too long are dropped. Descriptors sent to
+ * be stored are not supported and closed.
+ *
+ * @param ev event
+ * @param events ready events
+ */
+static void notify_handler(event_t *ev, uint32_t events)
+{
+    char buf[NOTIFY_MSG_MAX + 1];
+    union
+    {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(struct ucred)) + CMSG_SPACE(sizeof(int) * NOTIFY_FDS_MAX)];
+    } control;
+
+    while (1)
+    {
+        struct iovec iov = {
+            .iov_base = buf,
+            .iov_len = NOTIFY_MSG_MAX,
+        };
+        struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = &control,
+            .msg_controllen = sizeof(control),
+        };
+        struct ucred *cred = NULL;
+
+        ssize_t len = recvmsg(ev->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno != EAGAIN)
+            {
+                log_error("failed to read notify socket: %s", strerror(errno));
+            }
+            return;
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET)
+            {
+                continue;
+            }
+
+            if (cmsg->cmsg_type == SCM_CREDENTIALS && cmsg->cmsg_len == CMSG_LEN(sizeof(struct ucred)))
+            {
+                cred = (struct ucred *)CMSG_DATA(cmsg);
+            }
+            else if (cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                close_passed_fds(cmsg);
+            }
+        }
+
+        if (!cred || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+        {
+            continue;
+        }
+
+        buf[len] = '\0';
+        supervisor_notify(cred->pid, buf);
+    }
+}
+
+/**
+ * @brief Watch the notify socket, if a service uses it
+ *
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int notify_init(void)
+{
+    if (notify_event.fd < 0)
+    {
+        return 0;
+    }
+
+    notify_event.handler = notify_handler;
+
+    return event_add(&notify_event, EPOLLIN);
+}
+
+/**
+ * @brief Close the notify socket
+ *
+ */
+void notify_cleanup(void)
+{
+    if (notify_event.fd >= 0)
+    {
+        event_del(&notify_event);
+        close(notify_event.fd);
+        notify_event.fd = -1;
+    }
+
+    free(notify_env);
+    notify_env = NULL;
+}
@@ -9,6 +9,33 @@
  * Date         Author                          Notes
  * 2025-12-22   Frank <uuidxx@163.com>          the first version
  * 2025-12-25   Frank <uuidxx@163.com>          add support for running user
+ * 2026-10-15   Frank <uuidxx@163.com>          add configurable stop signals and timeouts
+ * 2026-10-15   Frank <uuidxx@163.com>          add spawn backend selection
+ * 2026-10-15   Frank <uuidxx@163.com>          build the spawn plan
+ * 2026-10-15   Frank <uuidxx@163.com>          add exec-by-path option
+ * 2026-10-15   Frank <uuidxx@163.com>          add replicas option
+ * 2026-10-15   Frank <uuidxx@163.com>          add config file option
+ * 2026-10-15   Frank <uuidxx@163.com>          add respawn backoff options
+ * 2026-10-15   Frank <uuidxx@163.com>          add respawn rate limit options
+ * 2026-10-15   Frank <uuidxx@163.com>          add readiness and control socket options
+ * 2026-10-15   Frank <uuidxx@163.com>          add listen option
+ * 2026-10-15   Frank <uuidxx@163.com>          add notify option
+ * 2026-10-15   Frank <uuidxx@163.com>          add watchdog option
+ * 2026-10-15   Frank <uuidxx@163.com>          add health probe options
+ * 2026-10-15   Frank <uuidxx@163.com>          add restart-on-p99 option
+ * 2026-10-15   Frank <uuidxx@163.com>          add max-rss and max-cpu-percent options
+ * 2026-10-15   Frank <uuidxx@163.com>          add recycle-horizon option
+ * 2026-10-15   Frank <uuidxx@163.com>          add cgroup options
+ * 2026-10-15   Frank <uuidxx@163.com>          add kill-mode option
+ * 2026-10-15   Frank <uuidxx@163.com>          add subreaper option
+ * 2026-10-16   Frank <uuidxx@163.com>          add cpus and numa-node options
+ * 2026-10-16   Frank <uuidxx@163.com>          add rebalance option
+ * 2026-10-16   Frank <uuidxx@163.com>          add nice, sched, ioclass and oom-score-adj options
+ * 2026-10-16   Frank <uuidxx@163.com>          add rlimit option
+ * 2026-10-16   Frank <uuidxx@163.com>          give stop stages without a duration the final --stop-timeout
+ * 2026-10-16   Frank <uuidxx@163.com>          rename parse_cgroup_int to parse_int_range
+ * 2026-10-16   Frank <uuidxx@163.com>          keep --ready-timeout next to --ready-fd in the usage
+ * 2026-10-16   Frank <uuidxx@163.com>          respawn-max-delay only bounds the exp backoff
  *
  */
 
@@ -18,16 +45,22 @@
 #include <libgen.h>
 #include <limits.h>
 #include <pwd.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include "internal.h"
 #include "version.h"
 
+// Timeout of a stop stage given without a duration, until the options are final
+#define STOP_TIMEOUT_UNSET UINT64_MAX
+
 enum
 {
     OPT_STDOUT = 'o',
@@ -42,8 +75,89 @@ enum
     OPT_RESPAWN_CODE = 256,
     OPT_RESPAWN_DELAY,
     OPT_MAX_RESPAWNS,
+    OPT_STOP_SIGNAL,
+    OPT_STOP_TIMEOUT,
+    OPT_STOP_SEQUENCE,
+    OPT_KILL_MODE,
+    OPT_SPAWN,
+    OPT_EXEC_BY_PATH,
+    OPT_REPLICAS,
+    OPT_CONFIG,
+    OPT_RESPAWN_BACKOFF,
+    OPT_RESPAWN_MAX_DELAY,
+    OPT_RESPAWN_JITTER,
+    OPT_RESPAWN_RESET_AFTER,
+    OPT_RESPAWN_LIMIT,
+    OPT_RESPAWN_COOLDOWN,
+    OPT_READY_FD,
+    OPT_READY_TIMEOUT,
+    OPT_CONTROL,
+    OPT_SUBREAPER,
+    OPT_REBALANCE,
+    OPT_LISTEN,
+    OPT_NOTIFY,
+    OPT_WATCHDOG,
+    OPT_HEALTH_CMD,
+    OPT_HEALTH_TCP,
+    OPT_HEALTH_UNIX,
+    OPT_HEALTH_INTERVAL,
+    OPT_HEALTH_TIMEOUT,
+    OPT_HEALTH_RETRIES,
+    OPT_RESTART_ON_P99,
+    OPT_MAX_RSS,
+    OPT_MAX_CPU_PERCENT,
+    OPT_RECYCLE_HORIZON,
+    OPT_CGROUP,
+    OPT_MEMORY_MAX,
+    OPT_MEMORY_HIGH,
+    OPT_CPU_MAX,
+    OPT_CPU_WEIGHT,
+    OPT_IO_WEIGHT,
+    OPT_PIDS_MAX,
+    OPT_CPUS,
+    OPT_NUMA_NODE,
+    OPT_NICE,
+    OPT_SCHED,
+    OPT_IOCLASS,
+    OPT_OOM_SCORE_ADJ,
+    OPT_RLIMIT,
 };
 
+// Upper bound of --replicas
+#define MAX_REPLICAS 4096
+
+// Upper bound of the moves per round of --rebalance
+#define MAX_REBALANCE_MOVES 64
+
+// Bounds of --nice
+#define MIN_NICE -20
+#define MAX_NICE 19
+
+// Bounds of the real-time priority of --sched
+#define MIN_SCHED_PRIORITY 1
+#define MAX_SCHED_PRIORITY 99
+
+// Default and upper bound of the priority of --ioclass, 0 being the highest
+#define DEFAULT_IO_PRIORITY 4
+#define MAX_IO_PRIORITY 7
+
+// Bounds of --oom-score-adj
+#define MIN_OOM_SCORE_ADJ -1000
+#define MAX_OOM_SCORE_ADJ 1000
+
+// Upper bound of the respawn count of --respawn-limit
+#define MAX_RESPAWN_LIMIT_BURST 1000
+
+// Upper bound of --health-retries
+#define MAX_HEALTH_RETRIES 1000
+
+// Upper bound of the percentage of --max-cpu-percent and --cpu-max, a thousand CPUs
+#define MAX_CPU_PERCENT 100000
+
+// Bounds of cpu.weight and io.weight
+#define MIN_CGROUP_WEIGHT 1
+#define MAX_CGROUP_WEIGHT 10000
+
 // short options
 // use the "+" prefix to prevent getopt_long from rearranging the order of argv.
 static const char *short_opts = "+o:e:c:u:E:p:rhV";
@@ -59,7 +173,53 @@ static const struct option long_opts[] = {
     {"respawn", no_argument, NULL, OPT_RESPAWN},
     {"respawn-code", required_argument, NULL, OPT_RESPAWN_CODE},
     {"respawn-delay", required_argument, NULL, OPT_RESPAWN_DELAY},
+    {"respawn-backoff", required_argument, NULL, OPT_RESPAWN_BACKOFF},
+    {"respawn-max-delay", required_argument, NULL, OPT_RESPAWN_MAX_DELAY},
+    {"respawn-jitter", required_argument, NULL, OPT_RESPAWN_JITTER},
+    {"respawn-reset-after", required_argument, NULL, OPT_RESPAWN_RESET_AFTER},
+    {"respawn-limit", required_argument, NULL, OPT_RESPAWN_LIMIT},
+    {"respawn-cooldown", required_argument, NULL, OPT_RESPAWN_COOLDOWN},
     {"max-respawns", required_argument, NULL, OPT_MAX_RESPAWNS},
+    {"stop-signal", required_argument, NULL, OPT_STOP_SIGNAL},
+    {"stop-timeout", required_argument, NULL, OPT_STOP_TIMEOUT},
+    {"stop-sequence", required_argument, NULL, OPT_STOP_SEQUENCE},
+    {"kill-mode", required_argument, NULL, OPT_KILL_MODE},
+    {"spawn", required_argument, NULL, OPT_SPAWN},
+    {"exec-by-path", no_argument, NULL, OPT_EXEC_BY_PATH},
+    {"replicas", required_argument, NULL, OPT_REPLICAS},
+    {"ready-fd", required_argument, NULL, OPT_READY_FD},
+    {"ready-timeout", required_argument, NULL, OPT_READY_TIMEOUT},
+    {"notify", no_argument, NULL, OPT_NOTIFY},
+    {"watchdog", required_argument, NULL, OPT_WATCHDOG},
+    {"health-cmd", required_argument, NULL, OPT_HEALTH_CMD},
+    {"health-tcp", required_argument, NULL, OPT_HEALTH_TCP},
+    {"health-unix", required_argument, NULL, OPT_HEALTH_UNIX},
+    {"health-interval", required_argument, NULL, OPT_HEALTH_INTERVAL},
+    {"health-timeout", required_argument, NULL, OPT_HEALTH_TIMEOUT},
+    {"health-retries", required_argument, NULL, OPT_HEALTH_RETRIES},
+    {"restart-on-p99", required_argument, NULL, OPT_RESTART_ON_P99},
+    {"max-rss", required_argument, NULL, OPT_MAX_RSS},
+    {"max-cpu-percent", required_argument, NULL, OPT_MAX_CPU_PERCENT},
+    {"recycle-horizon", required_argument, NULL, OPT_RECYCLE_HORIZON},
+    {"cgroup", required_argument, NULL, OPT_CGROUP},
+    {"memory-max", required_argument, NULL, OPT_MEMORY_MAX},
+    {"memory-high", required_argument, NULL, OPT_MEMORY_HIGH},
+    {"cpu-max", required_argument, NULL, OPT_CPU_MAX},
+    {"cpu-weight", required_argument, NULL, OPT_CPU_WEIGHT},
+    {"io-weight", required_argument, NULL, OPT_IO_WEIGHT},
+    {"pids-max", required_argument, NULL, OPT_PIDS_MAX},
+    {"cpus", required_argument, NULL, OPT_CPUS},
+    {"numa-node", required_argument, NULL, OPT_NUMA_NODE},
+    {"nice", required_argument, NULL, OPT_NICE},
+    {"sched", required_argument, NULL, OPT_SCHED},
+    {"ioclass", required_argument, NULL, OPT_IOCLASS},
+    {"oom-score-adj", required_argument, NULL, OPT_OOM_SCORE_ADJ},
+    {"rlimit", required_argument, NULL, OPT_RLIMIT},
+    {"listen", required_argument, NULL, OPT_LISTEN},
+    {"config", required_argument, NULL, OPT_CONFIG},
+    {"control", required_argument, NULL, OPT_CONTROL},
+    {"subreaper", no_argument, NULL, OPT_SUBREAPER},
+    {"rebalance", required_argument, NULL, OPT_REBALANCE},
     {"help", no_argument, NULL, OPT_HELP},
     {"version", no_argument, NULL, OPT_VERSION},
     {0, 0, 0, 0},
@@ -67,12 +227,16 @@ static const struct option long_opts[] = {
 
 static const char usage_text[] = {
     "usage: %s [options...] <target> [target_args...]\n"
+    "       %s [-p FILE] [--control=FILE] [--subreaper] [--rebalance=INTERVAL[:MOVES]]\n"
+    "          --config=FILE\n"
     "\n"
     "A lightweight daemonizer and process supervisor.\n"
     "\n"
     "Options:\n"
     " -o, --stdout=FILE          Redirect stdout to FILE (default: /dev/null)\n"
+    "                              %%i in FILE is replaced by the replica index\n"
     " -e, --stderr=FILE          Redirect stderr to FILE (default: /dev/null)\n"
+    "                              %%i in FILE is replaced by the replica index\n"
     " -c, --chdir=DIR            Change working directory to DIR\n"
     " -u, --user=USER[:GROUP]    Run target as USER and optionally GROUP\n"
     " -E, --env=NAME=VALUE       Set environment variable\n"
@@ -83,10 +247,164 @@ static const char usage_text[] = {
     "                              Can be used multiple times\n"
     "                              Use -1 for any codes\n"
     "                              Default: any non-zero codes (if -r is set)\n"
-    "     --respawn-delay=N      Wait N seconds before respawning (default: 3)\n"
-    "     --max-respawns=N       Maximum respawn attempts (default: 0 = unlimited)\n"
+    "     --respawn-delay=DURATION\n"
+    "                            Wait DURATION before respawning (default: 3s)\n"
+    "     --respawn-backoff=MODE Respawn delay policy: fixed (default) or exp,\n"
+    "                              which doubles the delay after each respawn\n"
+    "     --respawn-max-delay=DURATION\n"
+    "                            Upper bound of the exp respawn delay\n"
+    "                              (default: 60s)\n"
+    "     --respawn-jitter=PERCENT\n"
+    "                            Randomly shorten each respawn delay by up to\n"
+    "                              PERCENT%% (default: 0)\n"
+    "     --respawn-reset-after=DURATION\n"
+    "                            Restart the backoff and the respawn count when\n"
+    "                              the target ran at least DURATION (default: 60s)\n"
+    "     --respawn-limit=N/DURATION\n"
+    "                            Suspend respawning when the target respawned N\n"
+    "                              times within DURATION, e.g. 5/60s\n"
+    "     --respawn-cooldown=DURATION\n"
+    "                            Time respawning stays suspended before a trial\n"
+    "                              respawn (default: the --respawn-limit window)\n"
+    "     --max-respawns=N       Maximum consecutive respawn attempts, counted\n"
+    "                              until the target runs for --respawn-reset-after\n"
+    "                              (default: 0 = unlimited)\n"
+    "     --stop-signal=SIG      Signal sent to stop the target (default: TERM)\n"
+    "     --stop-timeout=DURATION\n"
+    "                            Time to wait before sending SIGKILL (default: 10s)\n"
+    "     --stop-sequence=SIG[:DURATION][,...]\n"
+    "                            Signals sent in turn to stop the target, waiting\n"
+    "                              DURATION after each one, e.g. QUIT:5s,TERM:10s\n"
+    "                              (default DURATION: --stop-timeout)\n"
+    "                              SIGKILL is always sent last\n"
+    "                              Overrides --stop-signal\n"
+    "     --kill-mode=MODE       Processes the stop signals are sent to: process,\n"
+    "                              group for the process group of the target, or\n"
+    "                              cgroup for its whole cgroup (default: process)\n"
+    "                              With group or cgroup, the processes left when\n"
+    "                              the target exits are killed\n"
+    "     --spawn=BACKEND        Method used to spawn the target: fork, vfork\n"
+    "                              or clone3 (default: %s)\n"
+    "     --exec-by-path         Resolve the target path on every respawn instead\n"
+    "                              of executing the file opened at startup\n"
+    "     --replicas=N           Run N instances of the target (default: 1)\n"
+    "                              Each one gets RUND_REPLICA set to its index\n"
+    "     --ready-fd=N           The target writes a line to descriptor N once it\n"
+    "                              is ready to serve\n"
+    "     --ready-timeout=DURATION\n"
+    "                            Time a restarted target has to become ready\n"
+    "                              before the restart is rolled back (default: 30s)\n"
+    "     --notify               The target reports its state with sd_notify() to\n"
+    "                              the socket in NOTIFY_SOCKET, and is ready once\n"
+    "                              it sends READY=1\n"
+    "     --watchdog=DURATION    The target sends WATCHDOG=1 to NOTIFY_SOCKET at\n"
+    "                              least every DURATION, given in WATCHDOG_USEC,\n"
+    "                              or it is stopped and respawned\n"
+    "     --health-cmd=CMD       Probe the target by running CMD with /bin/sh,\n"
+    "                              healthy if it exits with 0\n"
+    "     --health-tcp=[HOST:]PORT\n"
+    "                            Probe the target by connecting to PORT on HOST\n"
+    "                              (default: 127.0.0.1)\n"
+    "     --health-unix=PATH     Probe the target by connecting to the unix\n"
+    "                              socket PATH\n"
+    "     --health-interval=DURATION\n"
+    "                            Time between two probes (default: 10s)\n"
+    "     --health-timeout=DURATION\n"
+    "                            Time after which a probe fails (default: 5s)\n"
+    "     --health-retries=N     Restart the target after N consecutive failed\n"
+    "                              probes (default: 3)\n"
+    "     --restart-on-p99=DURATION\n"
+    "                            Restart the target without downtime when the p99\n"
+    "                              latency of its last 100 successful probes\n"
+    "                              exceeds DURATION\n"
+    "     --max-rss=SIZE         Restart the target when its resident set size\n"
+    "                              exceeds SIZE bytes, with an optional K, M or G\n"
+    "                              suffix\n"
+    "     --recycle-horizon=DURATION\n"
+    "                            Restart the target without downtime when its RSS\n"
+    "                              growth trend reaches --max-rss within DURATION\n"
+    "     --max-cpu-percent=N:WINDOW\n"
+    "                            Restart the target when it uses more than N%%\n"
+    "                              of a CPU over WINDOW\n"
+    "     --cgroup=ROOT          Spawn the target into the cgroup v2 ROOT/NAME,\n"
+    "                              NAME being the service name\n"
+    "     --memory-max=SIZE      memory.max of the cgroup\n"
+    "     --memory-high=SIZE     memory.high of the cgroup\n"
+    "     --cpu-max=PERCENT      cpu.max of the cgroup, 100 is a full CPU\n"
+    "     --cpu-weight=N         cpu.weight of the cgroup, 1 to 10000\n"
+    "     --io-weight=N          io.weight of the cgroup, 1 to 10000\n"
+    "     --pids-max=N           pids.max of the cgroup\n"
+    "     --cpus=LIST            Pin the target to the CPUs of LIST, e.g. 0-3,8,\n"
+    "                              or spread the replicas over the cores with auto\n"
+    "     --numa-node=N          Bind the memory of the target to NUMA node N and\n"
+    "                              pin it to the CPUs of the node, or spread the\n"
+    "                              replicas over the nodes with auto\n"
+    "     --nice=N               Nice value of the target, -20 to 19\n"
+    "     --sched=POLICY[:PRIO]  Scheduling policy of the target: fifo or rr,\n"
+    "                              with a priority from 1 to 99 (default: 1),\n"
+    "                              batch or idle\n"
+    "     --ioclass=CLASS[:PRIO] IO scheduling class of the target: rt or be,\n"
+    "                              with a priority from 0 to 7 (default: 4), or idle\n"
+    "     --oom-score-adj=N      OOM score adjustment of the target, -1000 to 1000\n"
+    "     --rlimit=NAME=SOFT[:HARD]\n"
+    "                            Resource limit of the target, NAME being NOFILE,\n"
+    "                              MEMLOCK, CORE, NPROC or STACK; SOFT and HARD\n"
+    "                              are numbers with an optional K, M or G suffix,\n"
+    "                              or unlimited, HARD defaults to SOFT.\n"
+    "                              Can be used multiple times\n"
+    "     --listen=ADDR          Open a listener held across respawns and pass it\n"
+    "                              to the target with LISTEN_FDS, from descriptor 3\n"
+    "                              on; ADDR is tcp:[HOST:]PORT, udp:[HOST:]PORT\n"
+    "                              or unix:PATH. Can be used multiple times\n"
+    "     --config=FILE          Supervise the services defined in FILE instead\n"
+    "                              of a target given on the command line\n"
+    "     --control=FILE         Accept commands on the unix socket FILE:\n"
+    "                              status, latency, restart [NAME]\n"
+    "     --subreaper            Adopt and reap the orphaned descendants of the\n"
+    "                              targets, counted in the status of their instance\n"
+    "     --rebalance=INTERVAL[:MOVES]\n"
+    "                            Every INTERVAL, move at most MOVES (default: 1)\n"
+    "                              instances spread by --cpus=auto between the\n"
+    "                              cores of their NUMA node to even out the load\n"
     " -h, --help                 Display this help message and exit\n"
-    " -V, --version              Show version information and exit\n",
+    " -V, --version              Show version information and exit\n"
+    "\n"
+    "DURATION is a number with an optional unit: ms, s (default), m or h,\n"
+    "e.g. 500ms, 1.5s, 2m.\n",
+};
+
+// signal names accepted by options, with or without the "SIG" prefix
+static const struct
+{
+    const char *name;
+    int signo;
+} signal_names[] = {
+    {"HUP", SIGHUP},
+    {"INT", SIGINT},
+    {"QUIT", SIGQUIT},
+    {"KILL", SIGKILL},
+    {"USR1", SIGUSR1},
+    {"USR2", SIGUSR2},
+    {"ALRM", SIGALRM},
+    {"TERM", SIGTERM},
+    {"CONT", SIGCONT},
+    {"STOP", SIGSTOP},
+    {"TSTP", SIGTSTP},
+    {"WINCH", SIGWINCH},
+    {"PWR", SIGPWR},
+};
+
+// resource names accepted by --rlimit, with or without the "RLIMIT_" prefix
+static const struct
+{
+    const char *name;
+    int resource;
+} rlimit_names[] = {
+    {"NOFILE", RLIMIT_NOFILE},
+    {"MEMLOCK", RLIMIT_MEMLOCK},
+    {"CORE", RLIMIT_CORE},
+    {"NPROC", RLIMIT_NPROC},
+    {"STACK", RLIMIT_STACK},
 };
 
 /**
@@ -96,7 +414,7 @@ static const char usage_text[] = {
  */
 static void show_usage(FILE *stream, const char *prog_name)
 {
-    fprintf(stream, usage_text, prog_name);
+    fprintf(stream, usage_text, prog_name, prog_name, spawn_backend_name(RUND_DEFAULT_SPAWN_BACKEND));
 }
 
 /**
@@ -193,291 +511,1301 @@ static int parse_respawn_code(option_t *opt, const char *code_str)
 }
 
 /**
- * @brief Parse respawn delay
+ * @brief Parse duration
  *
- * @param opt option
- * @param delay_str delay string
+ * Accepts a non-negative decimal number followed by an optional unit
+ * (`ms`, `s`, `m` or `h`). A number without unit is in seconds.
+ *
+ * @param str duration string, e.g. "500ms", "1.5s"
+ * @param ms buffer to store the duration in milliseconds
  * @return int
  * @retval `0` ok
  * @retval `-1` failed
  */
-static int parse_respawn_delay(option_t *opt, const char *delay_str)
+static int parse_duration(const char *str, uint64_t *ms)
 {
-    if (!delay_str)
+    const char *p = str;
+    uint64_t integer = 0;
+    uint64_t fraction = 0;
+    uint64_t fraction_div = 1;
+    uint64_t unit;
+
+    if (*p < '0' || *p > '9')
     {
-        return 0;
+        return -1;
     }
 
-    char *endptr = NULL;
-    long delay = strtol(delay_str, &endptr, 10);
-    if (errno == ERANGE || delay < 0)
+    while (*p >= '0' && *p <= '9')
     {
-        log_error("failed to parse respawn delay '%s': out of range", delay_str);
-        return -1;
+        integer = integer * 10 + (*p - '0');
+        if (integer > UINT32_MAX)
+        {
+            return -1;
+        }
+        p++;
+    }
+
+    if (*p == '.')
+    {
+        p++;
+        if (*p < '0' || *p > '9')
+        {
+            return -1;
+        }
+
+        while (*p >= '0' && *p <= '9')
+        {
+            // digits beyond microseconds are meaningless here
+            if (fraction_div < 1000000)
+            {
+                fraction = fraction * 10 + (*p - '0');
+                fraction_div *= 10;
+            }
+            p++;
+        }
+    }
+
+    if (*p == '\0' || strcmp(p, "s") == 0)
+    {
+        unit = 1000;
+    }
+    else if (strcmp(p, "ms") == 0)
+    {
+        unit = 1;
+    }
+    else if (strcmp(p, "m") == 0)
+    {
+        unit = 60 * 1000;
+    }
+    else if (strcmp(p, "h") == 0)
+    {
+        unit = 60 * 60 * 1000;
     }
-    else if (delay_str == endptr || *endptr != '\0')
+    else
     {
-        log_error("failed to parse respawn delay '%s': not a number", delay_str);
         return -1;
     }
 
-    opt->respawn_delay = delay;
+    *ms = integer * unit + fraction * unit / fraction_div;
 
     return 0;
 }
 
 /**
- * @brief Parse max respawns
+ * @brief Parse an integer within a range
  *
- * @param opt option
- * @param count_str count string
+ * @param what value name for error messages
+ * @param value_str value string, a trailing '%' is allowed when `percent` is set
+ * @param min lower bound
+ * @param max upper bound
+ * @param percent whether the value is a percentage
+ * @param value buffer to store the value
  * @return int
  * @retval `0` ok
  * @retval `-1` failed
  */
-static int parse_max_respawn_count(option_t *opt, const char *count_str)
+static int parse_int_range(const char *what, const char *value_str, long min, long max, bool percent, int *value)
 {
-    if (!count_str)
+    if (!value_str)
     {
         return 0;
     }
 
     char *endptr = NULL;
-    long count = strtol(count_str, &endptr, 10);
-    if (errno == ERANGE || count < 0)
+
+    errno = 0;
+    long num = strtol(value_str, &endptr, 10);
+    if (percent && *endptr == '%')
     {
-        log_error("failed to parse max respawns '%s': out of range", count_str);
+        endptr++;
+    }
+
+    if (value_str == endptr || *endptr != '\0')
+    {
+        log_error("failed to parse %s '%s': invalid number", what, value_str);
         return -1;
     }
-    else if (count_str == endptr || *endptr != '\0')
+    else if (errno == ERANGE || num < min || num > max)
     {
-        log_error("failed to parse max respawns '%s': not a number", count_str);
+        log_error("failed to parse %s '%s': out of range [%ld, %ld]", what, value_str, min, max);
         return -1;
     }
 
-    opt->max_respawn_cnt = count;
+    *value = num;
 
     return 0;
 }
 
 /**
- * @brief Parse file path
+ * @brief Parse respawn delay
  *
- * @param dst pointer to store allocated path string
- * @param file file path
+ * @param opt option
+ * @param delay_str delay string
  * @return int
  * @retval `0` ok
  * @retval `-1` failed
  */
-static int general_parse_file(char **dst, const char *file)
+static int parse_respawn_delay(option_t *opt, const char *delay_str)
 {
-    if (!file)
+    if (!delay_str)
     {
-        return -1;
+        return 0;
     }
 
-    int rc;
-    char buf1[PATH_MAX + 1];
-    char buf2[PATH_MAX + 1];
-    char buf3[PATH_MAX + 1];
-    char *dir;
-    char *base_name;
-    struct stat st;
-
-    strncpy(buf1, file, PATH_MAX);
-    strncpy(buf2, file, PATH_MAX);
-
-    base_name = basename(buf1);
-    dir = dirname(buf2);
-
-    dir = realpath(dir, buf3);
-    if (!dir)
+    if (parse_duration(delay_str, &opt->respawn_delay_ms) < 0)
     {
-        log_error("%s: %s", buf2, strerror(errno));
+        log_error("failed to parse respawn delay '%s': invalid duration", delay_str);
         return -1;
     }
 
-    rc = access(dir, F_OK | X_OK);
-    if (rc != 0)
+    return 0;
+}
+
+/**
+ * @brief Parse respawn backoff
+ *
+ * @param opt option
+ * @param backoff_str backoff mode, "fixed" or "exp"
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_respawn_backoff(option_t *opt, const char *backoff_str)
+{
+    if (!backoff_str)
     {
-        log_error("%s: %s", dir, strerror(errno));
-        return -1;
+        return 0;
     }
 
-    rc = stat(dir, &st);
-    if (rc != 0)
+    if (strcmp(backoff_str, "fixed") == 0)
     {
-        log_error("%s: %s", dir, strerror(errno));
-        return -1;
+        opt->respawn_backoff = RESPAWN_BACKOFF_FIXED;
     }
-
-    if (!S_ISDIR(st.st_mode))
+    else if (strcmp(backoff_str, "exp") == 0)
     {
-        log_error("%s: not a directory", dir);
-        return -1;
+        opt->respawn_backoff = RESPAWN_BACKOFF_EXP;
     }
-
-    snprintf(buf2, sizeof(buf2), "%s/%s", dir, base_name);
-
-    if (*dst)
+    else
     {
-        free(*dst);
+        log_error("failed to parse respawn backoff '%s': expected fixed or exp", backoff_str);
+        return -1;
     }
 
-    *dst = strdup(buf2);
-
     return 0;
 }
 
 /**
- * @brief Parse stderr file path
+ * @brief Parse respawn max delay
  *
  * @param opt option
- * @param file file path
+ * @param delay_str delay string
  * @return int
  * @retval `0` ok
  * @retval `-1` failed
  */
-static int parse_stdout_file(option_t *opt, const char *file)
+static int parse_respawn_max_delay(option_t *opt, const char *delay_str)
 {
-    return general_parse_file(&opt->stdout_file, file);
+    if (!delay_str)
+    {
+        return 0;
+    }
+
+    if (parse_duration(delay_str, &opt->respawn_max_delay_ms) < 0)
+    {
+        log_error("failed to parse respawn max delay '%s': invalid duration", delay_str);
+        return -1;
+    }
+
+    return 0;
 }
 
 /**
- * @brief Parse stderr file path
+ * @brief Parse respawn jitter
  *
  * @param opt option
- * @param file file path
+ * @param jitter_str percentage string, with an optional "%" suffix
  * @return int
  * @retval `0` ok
  * @retval `-1` failed
  */
-static int parse_stderr_file(option_t *opt, const char *file)
+static int parse_respawn_jitter(option_t *opt, const char *jitter_str)
 {
-    return general_parse_file(&opt->stderr_file, file);
+    if (!jitter_str)
+    {
+        return 0;
+    }
+
+    char *endptr = NULL;
+
+    errno = 0;
+    long jitter = strtol(jitter_str, &endptr, 10);
+    if (errno == ERANGE || jitter < 0 || jitter > 100)
+    {
+        log_error("failed to parse respawn jitter '%s': out of range [0, 100]", jitter_str);
+        return -1;
+    }
+    else if (jitter_str == endptr || (*endptr != '\0' && strcmp(endptr, "%") != 0))
+    {
+        log_error("failed to parse respawn jitter '%s': not a number", jitter_str);
+        return -1;
+    }
+
+    opt->respawn_jitter = jitter;
+
+    return 0;
 }
 
 /**
- * @brief Parse working directory
+ * @brief Parse respawn reset time
  *
  * @param opt option
- * @param dir working directory
+ * @param time_str duration string
  * @return int
  * @retval `0` ok
  * @retval `-1` failed
  */
-static int parse_working_dir(option_t *opt, const char *dir)
+static int parse_respawn_reset_after(option_t *opt, const char *time_str)
 {
-    if (!dir)
+    if (!time_str)
     {
-        return -1;
+        return 0;
     }
 
-    int rc;
-    char abs_path_buf[PATH_MAX];
-    char *abs_path;
-    struct stat st;
-
-    abs_path = realpath(dir, abs_path_buf);
-    if (!abs_path)
+    if (parse_duration(time_str, &opt->respawn_reset_ms) < 0)
     {
-        log_error("%s: %s", dir, strerror(errno));
+        log_error("failed to parse respawn reset time '%s': invalid duration", time_str);
         return -1;
     }
 
-    rc = access(abs_path, F_OK | X_OK);
-    if (rc != 0)
+    return 0;
+}
+
+/**
+ * @brief Parse respawn limit
+ *
+ * @param opt option
+ * @param limit_str limit string, format: N/DURATION
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_respawn_limit(option_t *opt, const char *limit_str)
+{
+    if (!limit_str)
     {
-        log_error("%s: %s", abs_path, strerror(errno));
-        return -1;
+        return 0;
     }
 
-    rc = stat(abs_path, &st);
-    if (rc != 0)
+    char *endptr = NULL;
+
+    errno = 0;
+    long burst = strtol(limit_str, &endptr, 10);
+    if (limit_str == endptr || *endptr != '/')
     {
-        log_error("%s: %s", abs_path, strerror(errno));
+        log_error("failed to parse respawn limit '%s': expected N/DURATION", limit_str);
         return -1;
     }
-
-    if (!S_ISDIR(st.st_mode))
+    else if (errno == ERANGE || burst < 1 || burst > MAX_RESPAWN_LIMIT_BURST)
     {
-        log_error("%s: not a directory", abs_path);
+        log_error("failed to parse respawn limit '%s': out of range [1, %d]", limit_str, MAX_RESPAWN_LIMIT_BURST);
         return -1;
     }
 
-    if (opt->working_dir)
+    uint64_t window_ms;
+    if (parse_duration(endptr + 1, &window_ms) < 0 || window_ms == 0)
     {
-        free(opt->working_dir);
+        log_error("failed to parse respawn limit '%s': invalid duration", limit_str);
+        return -1;
     }
 
-    opt->working_dir = strdup(abs_path);
+    opt->respawn_limit_burst = burst;
+    opt->respawn_limit_window_ms = window_ms;
 
     return 0;
 }
 
 /**
- * @brief Parse user and group
+ * @brief Parse respawn cooldown
  *
  * @param opt option
- * @param user_str user string, format: USER[:GROUP]
+ * @param cooldown_str duration string
  * @return int
  * @retval `0` ok
  * @retval `-1` failed
  */
-static int parse_user(option_t *opt, const char *user_str)
+static int parse_respawn_cooldown(option_t *opt, const char *cooldown_str)
 {
-    if (!user_str)
-    {
-        return -1;
-    }
-
-    char *group = NULL,
-         *sep = NULL;
-    size_t username_len = strlen(user_str);
-
-    sep = strchr(user_str, ':');
-    if (sep)
+    if (!cooldown_str)
     {
-        group = sep + 1;
-        username_len = sep - user_str;
+        return 0;
     }
 
-    char *username = strndup(user_str, username_len);
-
-    struct passwd *pw = getpwnam(username);
-    if (!pw)
+    if (parse_duration(cooldown_str, &opt->respawn_cooldown_ms) < 0)
     {
-        log_error("error: user '%s' not found", username);
-        free(username);
+        log_error("failed to parse respawn cooldown '%s': invalid duration", cooldown_str);
         return -1;
     }
 
-    uid_t uid = pw->pw_uid;
-    gid_t gid = pw->pw_gid;
+    return 0;
+}
 
-    // group specified
-    if (group && *group != '\0')
+/**
+ * @brief Parse signal
+ *
+ * @param str signal name (e.g. "TERM", "SIGTERM") or number
+ * @return int
+ * @retval `>0` signal number
+ * @retval `-1` failed
+ */
+static int parse_signal(const char *str)
+{
+    char *endptr = NULL;
+
+    errno = 0;
+    long signo = strtol(str, &endptr, 10);
+    if (str != endptr && *endptr == '\0')
     {
-        struct group *grp = getgrnam(group);
-        if (!grp)
+        if (errno == ERANGE || signo <= 0 || signo >= NSIG)
         {
-            log_error("error: group '%s' not found", group);
             return -1;
         }
 
-        gid = grp->gr_gid;
+        return signo;
     }
 
-    if (opt->user)
+    if (strncasecmp(str, "SIG", 3) == 0)
     {
-        free(opt->user);
+        str += 3;
     }
-    if (opt->home_dir)
+
+    for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
     {
-        free(opt->home_dir);
+        if (strcasecmp(str, signal_names[i].name) == 0)
+        {
+            return signal_names[i].signo;
+        }
     }
 
-    opt->user = username;
+    return -1;
+}
+
+/**
+ * @brief Parse stop signal
+ *
+ * @param opt option
+ * @param sig_str signal string
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_stop_signal(option_t *opt, const char *sig_str)
+{
+    if (!sig_str)
+    {
+        return 0;
+    }
+
+    int signo = parse_signal(sig_str);
+    if (signo < 0)
+    {
+        log_error("failed to parse stop signal '%s': unknown signal", sig_str);
+        return -1;
+    }
+
+    opt->stop_signal = signo;
+
+    return 0;
+}
+
+/**
+ * @brief Parse stop timeout
+ *
+ * @param opt option
+ * @param timeout_str timeout string
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_stop_timeout(option_t *opt, const char *timeout_str)
+{
+    if (!timeout_str)
+    {
+        return 0;
+    }
+
+    if (parse_duration(timeout_str, &opt->stop_timeout_ms) < 0)
+    {
+        log_error("failed to parse stop timeout '%s': invalid duration", timeout_str);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse stop sequence
+ *
+ * @param opt option
+ * @param seq_str sequence string, format: SIG[:DURATION][,SIG[:DURATION]...]
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_stop_sequence(option_t *opt, const char *seq_str)
+{
+    if (!seq_str)
+    {
+        return 0;
+    }
+
+    int rc = 0;
+    char *saveptr = NULL;
+    size_t cnt = 0;
+
+    char *buf = strdup(seq_str);
+    if (!buf)
+    {
+        log_error("failed to strdup: %s", strerror(errno));
+        return -1;
+    }
+
+    for (char *stage = strtok_r(buf, ",", &saveptr); stage; stage = strtok_r(NULL, ",", &saveptr))
+    {
+        // reserve the last slot for SIGKILL
+        if (cnt >= STOP_STAGES_MAX - 1)
+        {
+            log_error("failed to parse stop sequence '%s': too many stages", seq_str);
+            rc = -1;
+            break;
+        }
+
+        // --stop-timeout may still follow, finalize_stop_sequence() fills it in
+        uint64_t timeout_ms = STOP_TIMEOUT_UNSET;
+        char *sep = strchr(stage, ':');
+        if (sep)
+        {
+            *sep = '\0';
+            if (parse_duration(sep + 1, &timeout_ms) < 0)
+            {
+                log_error("failed to parse stop sequence '%s': invalid duration '%s'", seq_str, sep + 1);
+                rc = -1;
+                break;
+            }
+        }
+
+        int signo = parse_signal(stage);
+        if (signo < 0)
+        {
+            log_error("failed to parse stop sequence '%s': unknown signal '%s'", seq_str, stage);
+            rc = -1;
+            break;
+        }
+
+        opt->stop_stages[cnt].signo = signo;
+        opt->stop_stages[cnt].timeout_ms = timeout_ms;
+        cnt++;
+    }
+
+    if (rc == 0 && cnt == 0)
+    {
+        log_error("failed to parse stop sequence '%s': empty", seq_str);
+        rc = -1;
+    }
+
+    if (rc == 0)
+    {
+        opt->stop_stage_cnt = cnt;
+    }
+
+    free(buf);
+
+    return rc;
+}
+
+/**
+ * @brief Build the stop sequence from the stop options
+ *
+ * Falls back to --stop-signal and --stop-timeout when no sequence is given,
+ * gives the stages without a duration --stop-timeout, and terminates the
+ * sequence with SIGKILL.
+ *
+ * @param opt option
+ */
+static void finalize_stop_sequence(option_t *opt)
+{
+    if (opt->stop_stage_cnt == 0)
+    {
+        opt->stop_stages[0].signo = opt->stop_signal;
+        opt->stop_stages[0].timeout_ms = opt->stop_timeout_ms;
+        opt->stop_stage_cnt = 1;
+    }
+
+    for (size_t i = 0; i < opt->stop_stage_cnt; i++)
+    {
+        if (opt->stop_stages[i].timeout_ms == STOP_TIMEOUT_UNSET)
+        {
+            opt->stop_stages[i].timeout_ms = opt->stop_timeout_ms;
+        }
+    }
+
+    if (opt->stop_stages[opt->stop_stage_cnt - 1].signo != SIGKILL)
+    {
+        opt->stop_stages[opt->stop_stage_cnt].signo = SIGKILL;
+        opt->stop_stage_cnt++;
+    }
+
+    // wait for the process to exit after the last stage
+    opt->stop_stages[opt->stop_stage_cnt - 1].timeout_ms = 0;
+}
+
+/**
+ * @brief Parse kill mode
+ *
+ * @param opt option
+ * @param mode_str kill mode, "process", "group" or "cgroup"
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_kill_mode(option_t *opt, const char *mode_str)
+{
+    if (!mode_str)
+    {
+        return 0;
+    }
+
+    if (strcmp(mode_str, "process") == 0)
+    {
+        opt->kill_mode = KILL_MODE_PROCESS;
+    }
+    else if (strcmp(mode_str, "group") == 0)
+    {
+        opt->kill_mode = KILL_MODE_GROUP;
+    }
+    else if (strcmp(mode_str, "cgroup") == 0)
+    {
+        opt->kill_mode = KILL_MODE_CGROUP;
+    }
+    else
+    {
+        log_error("failed to parse kill mode '%s': expected process, group or cgroup", mode_str);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse spawn backend
+ *
+ * @param opt option
+ * @param backend_str backend name
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_spawn_backend(option_t *opt, const char *backend_str)
+{
+    if (!backend_str)
+    {
+        return 0;
+    }
+
+    int backend = spawn_backend_from_name(backend_str);
+    if (backend < 0)
+    {
+        log_error("failed to parse spawn backend '%s': unknown backend", backend_str);
+        return -1;
+    }
+
+    opt->spawn_backend = backend;
+
+    return 0;
+}
+
+/**
+ * @brief Parse replica count
+ *
+ * @param opt option
+ * @param count_str count string
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_replica_count(option_t *opt, const char *count_str)
+{
+    if (!count_str)
+    {
+        return 0;
+    }
+
+    char *endptr = NULL;
+
+    errno = 0;
+    long count = strtol(count_str, &endptr, 10);
+    if (errno == ERANGE || count < 1 || count > MAX_REPLICAS)
+    {
+        log_error("failed to parse replicas '%s': out of range [1, %d]", count_str, MAX_REPLICAS);
+        return -1;
+    }
+    else if (count_str == endptr || *endptr != '\0')
+    {
+        log_error("failed to parse replicas '%s': not a number", count_str);
+        return -1;
+    }
+
+    opt->replica_cnt = count;
+
+    return 0;
+}
+
+/**
+ * @brief Parse ready fd
+ *
+ * @param opt option
+ * @param fd_str descriptor number string
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_ready_fd(option_t *opt, const char *fd_str)
+{
+    if (!fd_str)
+    {
+        return 0;
+    }
+
+    char *endptr = NULL;
+
+    errno = 0;
+    long fd = strtol(fd_str, &endptr, 10);
+    if (errno == ERANGE || fd < 3 || fd > 1023)
+    {
+        log_error("failed to parse ready fd '%s': out of range [3, 1023]", fd_str);
+        return -1;
+    }
+    else if (fd_str == endptr || *endptr != '\0')
+    {
+        log_error("failed to parse ready fd '%s': not a number", fd_str);
+        return -1;
+    }
+
+    opt->ready_fd = fd;
+
+    return 0;
+}
+
+/**
+ * @brief Parse ready timeout
+ *
+ * @param opt option
+ * @param timeout_str timeout string
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_ready_timeout(option_t *opt, const char *timeout_str)
+{
+    if (!timeout_str)
+    {
+        return 0;
+    }
+
+    if (parse_duration(timeout_str, &opt->ready_timeout_ms) < 0)
+    {
+        log_error("failed to parse ready timeout '%s': invalid duration", timeout_str);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse watchdog timeout
+ *
+ * @param opt option
+ * @param timeout_str timeout string, 0 to disable the watchdog
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_watchdog(option_t *opt, const char *timeout_str)
+{
+    if (!timeout_str)
+    {
+        return 0;
+    }
+
+    if (parse_duration(timeout_str, &opt->watchdog_ms) < 0)
+    {
+        log_error("failed to parse watchdog '%s': invalid duration", timeout_str);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Append a listener to option
+ *
+ * The listener is opened with the spawn plan.
+ *
+ * @param opt option
+ * @param spec listener spec
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int append_listen(option_t *opt, const char *spec)
+{
+    if (!spec)
+    {
+        return 0;
+    }
+
+    if (opt->listen_cnt >= LISTEN_FDS_MAX)
+    {
+        log_error("failed to parse listener '%s': at most %d listeners", spec, LISTEN_FDS_MAX);
+        return -1;
+    }
+
+    if (listen_check_spec(spec) < 0)
+    {
+        return -1;
+    }
+
+    char **temp = (char **)realloc(opt->listens, (opt->listen_cnt + 1) * sizeof(char *));
+    if (!temp)
+    {
+        log_error("failed to realloc: %s", strerror(errno));
+        return -1;
+    }
+
+    opt->listens = temp;
+    opt->listens[opt->listen_cnt] = strdup(spec);
+
+    opt->listen_cnt++;
+
+    return 0;
+}
+
+/**
+ * @brief Parse max respawns
+ *
+ * @param opt option
+ * @param count_str count string
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_max_respawn_count(option_t *opt, const char *count_str)
+{
+    if (!count_str)
+    {
+        return 0;
+    }
+
+    char *endptr = NULL;
+    long count = strtol(count_str, &endptr, 10);
+    if (errno == ERANGE || count < 0)
+    {
+        log_error("failed to parse max respawns '%s': out of range", count_str);
+        return -1;
+    }
+    else if (count_str == endptr || *endptr != '\0')
+    {
+        log_error("failed to parse max respawns '%s': not a number", count_str);
+        return -1;
+    }
+
+    opt->max_respawn_cnt = count;
+
+    return 0;
+}
+
+/**
+ * @brief Parse a health probe
+ *
+ * @param opt option
+ * @param probe probe type
+ * @param arg command, [HOST:]PORT or unix socket path
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_health_probe(option_t *opt, enum HEALTH_PROBE probe, const char *arg)
+{
+    if (!arg)
+    {
+        return 0;
+    }
+
+    if (opt->health_probe != HEALTH_PROBE_NONE && opt->health_probe != probe)
+    {
+        log_error("error: only one of --health-cmd, --health-tcp and --health-unix can be used");
+        return -1;
+    }
+
+    opt->health_probe = probe;
+
+    if (probe != HEALTH_PROBE_CMD && health_resolve(opt, arg) < 0)
+    {
+        return -1;
+    }
+
+    free(opt->health_arg);
+    opt->health_arg = strdup(arg);
+
+    if (probe == HEALTH_PROBE_CMD)
+    {
+        opt->health_argv[0] = "/bin/sh";
+        opt->health_argv[1] = "-c";
+        opt->health_argv[2] = opt->health_arg;
+        opt->health_argv[3] = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse health probe interval, timeout or latency limit
+ *
+ * @param what option description for error messages
+ * @param duration_str duration string
+ * @param ms buffer to store the duration, must not be zero
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_health_duration(const char *what, const char *duration_str, uint64_t *ms)
+{
+    uint64_t value;
+
+    if (!duration_str)
+    {
+        return 0;
+    }
+
+    if (parse_duration(duration_str, &value) < 0 || value == 0)
+    {
+        log_error("failed to parse %s '%s': invalid duration", what, duration_str);
+        return -1;
+    }
+
+    *ms = value;
+
+    return 0;
+}
+
+/**
+ * @brief Parse health probe retries
+ *
+ * @param opt option
+ * @param retries_str retries string
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_health_retries(option_t *opt, const char *retries_str)
+{
+    if (!retries_str)
+    {
+        return 0;
+    }
+
+    char *endptr = NULL;
+
+    errno = 0;
+    long retries = strtol(retries_str, &endptr, 10);
+    if (errno == ERANGE || retries < 1 || retries > MAX_HEALTH_RETRIES)
+    {
+        log_error("failed to parse health retries '%s': out of range [1, %d]", retries_str, MAX_HEALTH_RETRIES);
+        return -1;
+    }
+    else if (retries_str == endptr || *endptr != '\0')
+    {
+        log_error("failed to parse health retries '%s': not a number", retries_str);
+        return -1;
+    }
+
+    opt->health_retries = retries;
+
+    return 0;
+}
+
+/**
+ * @brief Parse size
+ *
+ * Accepts a decimal number of bytes followed by an optional binary unit
+ * (`K`, `M` or `G`).
+ *
+ * @param str size string, e.g. "512M"
+ * @param bytes buffer to store the size in bytes
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_size(const char *str, uint64_t *bytes)
+{
+    char *endptr = NULL;
+    int shift = 0;
+
+    if (*str < '0' || *str > '9')
+    {
+        return -1;
+    }
+
+    errno = 0;
+    unsigned long long value = strtoull(str, &endptr, 10);
+    if (errno == ERANGE)
+    {
+        return -1;
+    }
+
+    if (*endptr == 'K' || *endptr == 'k')
+    {
+        shift = 10;
+    }
+    else if (*endptr == 'M' || *endptr == 'm')
+    {
+        shift = 20;
+    }
+    else if (*endptr == 'G' || *endptr == 'g')
+    {
+        shift = 30;
+    }
+    else if (*endptr != '\0')
+    {
+        return -1;
+    }
+
+    if (shift > 0 && *++endptr != '\0')
+    {
+        return -1;
+    }
+
+    if (value > (UINT64_MAX >> shift))
+    {
+        return -1;
+    }
+
+    *bytes = (uint64_t)value << shift;
+
+    return 0;
+}
+
+/**
+ * @brief Parse RSS limit
+ *
+ * @param opt option
+ * @param size_str size string
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_max_rss(option_t *opt, const char *size_str)
+{
+    if (!size_str)
+    {
+        return 0;
+    }
+
+    if (parse_size(size_str, &opt->max_rss_bytes) < 0 || opt->max_rss_bytes == 0)
+    {
+        log_error("failed to parse RSS limit '%s': invalid size", size_str);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse recycle horizon
+ *
+ * @param opt option
+ * @param horizon_str duration string
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_recycle_horizon(option_t *opt, const char *horizon_str)
+{
+    if (!horizon_str)
+    {
+        return 0;
+    }
+
+    if (parse_duration(horizon_str, &opt->recycle_horizon_ms) < 0 || opt->recycle_horizon_ms == 0)
+    {
+        log_error("failed to parse recycle horizon '%s': invalid duration", horizon_str);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse CPU limit
+ *
+ * @param opt option
+ * @param limit_str limit string, format: N:DURATION
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_max_cpu_percent(option_t *opt, const char *limit_str)
+{
+    if (!limit_str)
+    {
+        return 0;
+    }
+
+    char *endptr = NULL;
+
+    errno = 0;
+    long percent = strtol(limit_str, &endptr, 10);
+    if (limit_str == endptr || *endptr != ':')
+    {
+        log_error("failed to parse CPU limit '%s': expected N:DURATION", limit_str);
+        return -1;
+    }
+    else if (errno == ERANGE || percent < 1 || percent > MAX_CPU_PERCENT)
+    {
+        log_error("failed to parse CPU limit '%s': out of range [1, %d]", limit_str, MAX_CPU_PERCENT);
+        return -1;
+    }
+
+    uint64_t window_ms;
+    if (parse_duration(endptr + 1, &window_ms) < 0 || window_ms < RESOURCE_SAMPLE_MS)
+    {
+        log_error("failed to parse CPU limit '%s': window must be at least %d ms", limit_str, RESOURCE_SAMPLE_MS);
+        return -1;
+    }
+
+    opt->max_cpu_percent = percent;
+    opt->max_cpu_window_ms = window_ms;
+
+    return 0;
+}
+
+/**
+ * @brief Parse file path
+ *
+ * @param dst pointer to store allocated path string
+ * @param file file path
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int general_parse_file(char **dst, const char *file)
+{
+    if (!file)
+    {
+        return -1;
+    }
+
+    int rc;
+    char buf1[PATH_MAX + 1];
+    char buf2[PATH_MAX + 1];
+    char buf3[PATH_MAX + 1];
+    char *dir;
+    char *base_name;
+    struct stat st;
+
+    strncpy(buf1, file, PATH_MAX);
+    strncpy(buf2, file, PATH_MAX);
+
+    base_name = basename(buf1);
+    dir = dirname(buf2);
+
+    dir = realpath(dir, buf3);
+    if (!dir)
+    {
+        log_error("%s: %s", buf2, strerror(errno));
+        return -1;
+    }
+
+    rc = access(dir, F_OK | X_OK);
+    if (rc != 0)
+    {
+        log_error("%s: %s", dir, strerror(errno));
+        return -1;
+    }
+
+    rc = stat(dir, &st);
+    if (rc != 0)
+    {
+        log_error("%s: %s", dir, strerror(errno));
+        return -1;
+    }
+
+    if (!S_ISDIR(st.st_mode))
+    {
+        log_error("%s: not a directory", dir);
+        return -1;
+    }
+
+    snprintf(buf2, sizeof(buf2), "%s/%s", dir, base_name);
+
+    if (*dst)
+    {
+        free(*dst);
+    }
+
+    *dst = strdup(buf2);
+
+    return 0;
+}
+
+/**
+ * @brief Parse stderr file path
+ *
+ * @param opt option
+ * @param file file path
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_stdout_file(option_t *opt, const char *file)
+{
+    return general_parse_file(&opt->stdout_file, file);
+}
+
+/**
+ * @brief Parse stderr file path
+ *
+ * @param opt option
+ * @param file file path
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_stderr_file(option_t *opt, const char *file)
+{
+    return general_parse_file(&opt->stderr_file, file);
+}
+
+/**
+ * @brief Parse working directory
+ *
+ * @param opt option
+ * @param dir working directory
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_working_dir(option_t *opt, const char *dir)
+{
+    if (!dir)
+    {
+        return -1;
+    }
+
+    int rc;
+    char abs_path_buf[PATH_MAX];
+    char *abs_path;
+    struct stat st;
+
+    abs_path = realpath(dir, abs_path_buf);
+    if (!abs_path)
+    {
+        log_error("%s: %s", dir, strerror(errno));
+        return -1;
+    }
+
+    rc = access(abs_path, F_OK | X_OK);
+    if (rc != 0)
+    {
+        log_error("%s: %s", abs_path, strerror(errno));
+        return -1;
+    }
+
+    rc = stat(abs_path, &st);
+    if (rc != 0)
+    {
+        log_error("%s: %s", abs_path, strerror(errno));
+        return -1;
+    }
+
+    if (!S_ISDIR(st.st_mode))
+    {
+        log_error("%s: not a directory", abs_path);
+        return -1;
+    }
+
+    if (opt->working_dir)
+    {
+        free(opt->working_dir);
+    }
+
+    opt->working_dir = strdup(abs_path);
+
+    return 0;
+}
+
+/**
+ * @brief Parse user and group
+ *
+ * @param opt option
+ * @param user_str user string, format: USER[:GROUP]
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_user(option_t *opt, const char *user_str)
+{
+    if (!user_str)
+    {
+        return -1;
+    }
+
+    char *group = NULL,
+         *sep = NULL;
+    size_t username_len = strlen(user_str);
+
+    sep = strchr(user_str, ':');
+    if (sep)
+    {
+        group = sep + 1;
+        username_len = sep - user_str;
+    }
+
+    char *username = strndup(user_str, username_len);
+
+    struct passwd *pw = getpwnam(username);
+    if (!pw)
+    {
+        log_error("error: user '%s' not found", username);
+        free(username);
+        return -1;
+    }
+
+    uid_t uid = pw->pw_uid;
+    gid_t gid = pw->pw_gid;
+
+    // group specified
+    if (group && *group != '\0')
+    {
+        struct group *grp = getgrnam(group);
+        if (!grp)
+        {
+            log_error("error: group '%s' not found", group);
+            return -1;
+        }
+
+        gid = grp->gr_gid;
+    }
+
+    if (opt->user)
+    {
+        free(opt->user);
+    }
+    if (opt->home_dir)
+    {
+        free(opt->home_dir);
+    }
+
+    opt->user = username;
     opt->home_dir = strdup(pw->pw_dir);
     opt->uid = uid;
     opt->gid = gid;
@@ -486,7 +1814,445 @@ static int parse_user(option_t *opt, const char *user_str)
 }
 
 /**
- * @brief Parse pid file path
+ * @brief Parse pid file path
+ *
+ * @param opt option
+ * @param file file path
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_pid_file(option_t *opt, const char *file)
+{
+    return general_parse_file(&opt->pid_file, file);
+}
+
+/**
+ * @brief Parse cgroup root path
+ *
+ * @param opt option
+ * @param dir cgroup root path, its parent must exist
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_cgroup_root(option_t *opt, const char *dir)
+{
+    return general_parse_file(&opt->cgroup_root, dir);
+}
+
+/**
+ * @brief Parse a memory limit of the cgroup
+ *
+ * @param what limit name for error messages
+ * @param size_str size string
+ * @param bytes buffer to store the limit, must not be zero
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_cgroup_size(const char *what, const char *size_str, uint64_t *bytes)
+{
+    if (!size_str)
+    {
+        return 0;
+    }
+
+    if (parse_size(size_str, bytes) < 0 || *bytes == 0)
+    {
+        log_error("failed to parse %s '%s': invalid size", what, size_str);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse the CPUs the target is pinned to
+ *
+ * @param opt option
+ * @param list_str CPU list, e.g. 0-3,8, or "auto"
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_cpus(option_t *opt, const char *list_str)
+{
+    if (!list_str)
+    {
+        return 0;
+    }
+
+    if (strcmp(list_str, "auto") == 0)
+    {
+        memset(&opt->cpus, 0, sizeof(opt->cpus));
+        opt->cpu_cnt = CPUS_AUTO;
+        return 0;
+    }
+
+    int cnt = cpu_list_parse(list_str, &opt->cpus);
+    if (cnt <= 0)
+    {
+        log_error("failed to parse cpus '%s': expected auto or a list of CPUs below %d, e.g. 0-3,8", list_str,
+                  CPU_MASK_BITS);
+        return -1;
+    }
+
+    opt->cpu_cnt = cnt;
+
+    return 0;
+}
+
+/**
+ * @brief Parse the NUMA node the memory of the target is bound to
+ *
+ * @param opt option
+ * @param node_str node id, or "auto"
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_numa_node(option_t *opt, const char *node_str)
+{
+    if (!node_str)
+    {
+        return 0;
+    }
+
+    if (strcmp(node_str, "auto") == 0)
+    {
+        opt->numa_node = NUMA_NODE_AUTO;
+        return 0;
+    }
+
+    return parse_int_range("numa node", node_str, 0, CPU_MASK_BITS - 1, false, &opt->numa_node);
+}
+
+/**
+ * @brief Parse scheduling policy
+ *
+ * @param opt option
+ * @param sched_str format: fifo|rr[:PRIO], batch or idle
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_sched(option_t *opt, const char *sched_str)
+{
+    if (!sched_str)
+    {
+        return 0;
+    }
+
+    const char *prio_str = strchr(sched_str, ':');
+    size_t len = prio_str ? (size_t)(prio_str - sched_str) : strlen(sched_str);
+    enum SCHED_CLASS sched_class;
+
+    if (len == 4 && strncmp(sched_str, "fifo", len) == 0)
+    {
+        sched_class = SCHED_CLASS_FIFO;
+    }
+    else if (len == 2 && strncmp(sched_str, "rr", len) == 0)
+    {
+        sched_class = SCHED_CLASS_RR;
+    }
+    else if (len == 5 && strncmp(sched_str, "batch", len) == 0)
+    {
+        sched_class = SCHED_CLASS_BATCH;
+    }
+    else if (len == 4 && strncmp(sched_str, "idle", len) == 0)
+    {
+        sched_class = SCHED_CLASS_IDLE;
+    }
+    else
+    {
+        log_error("failed to parse sched '%s': expected fifo, rr, batch or idle", sched_str);
+        return -1;
+    }
+
+    opt->sched_priority = 0;
+
+    if (sched_class == SCHED_CLASS_FIFO || sched_class == SCHED_CLASS_RR)
+    {
+        opt->sched_priority = MIN_SCHED_PRIORITY;
+        if (prio_str && parse_int_range("sched priority", prio_str + 1, MIN_SCHED_PRIORITY, MAX_SCHED_PRIORITY,
+                                        false, &opt->sched_priority) < 0)
+        {
+            return -1;
+        }
+    }
+    else if (prio_str)
+    {
+        log_error("failed to parse sched '%s': batch and idle take no priority", sched_str);
+        return -1;
+    }
+
+    opt->sched_class = sched_class;
+
+    return 0;
+}
+
+/**
+ * @brief Parse IO scheduling class
+ *
+ * @param opt option
+ * @param class_str format: rt|be[:PRIO] or idle
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_ioclass(option_t *opt, const char *class_str)
+{
+    if (!class_str)
+    {
+        return 0;
+    }
+
+    const char *prio_str = strchr(class_str, ':');
+    size_t len = prio_str ? (size_t)(prio_str - class_str) : strlen(class_str);
+    enum IO_CLASS io_class;
+
+    if (len == 2 && strncmp(class_str, "rt", len) == 0)
+    {
+        io_class = IO_CLASS_RT;
+    }
+    else if (len == 2 && strncmp(class_str, "be", len) == 0)
+    {
+        io_class = IO_CLASS_BE;
+    }
+    else if (len == 4 && strncmp(class_str, "idle", len) == 0)
+    {
+        io_class = IO_CLASS_IDLE;
+    }
+    else
+    {
+        log_error("failed to parse ioclass '%s': expected rt, be or idle", class_str);
+        return -1;
+    }
+
+    opt->io_priority = 0;
+
+    if (io_class != IO_CLASS_IDLE)
+    {
+        opt->io_priority = DEFAULT_IO_PRIORITY;
+        if (prio_str && parse_int_range("io priority", prio_str + 1, 0, MAX_IO_PRIORITY, false,
+                                        &opt->io_priority) < 0)
+        {
+            return -1;
+        }
+    }
+    else if (prio_str)
+    {
+        log_error("failed to parse ioclass '%s': idle takes no priority", class_str);
+        return -1;
+    }
+
+    opt->io_class = io_class;
+
+    return 0;
+}
+
+/**
+ * @brief Parse a value of a resource limit
+ *
+ * @param str number with an optional K, M or G suffix, or "unlimited"
+ * @param value buffer to store the value, RLIMIT_UNLIMITED for no limit
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_rlimit_value(const char *str, uint64_t *value)
+{
+    if (strcmp(str, "unlimited") == 0 || strcmp(str, "infinity") == 0)
+    {
+        *value = RLIMIT_UNLIMITED;
+        return 0;
+    }
+
+    return parse_size(str, value);
+}
+
+/**
+ * @brief Read the most open files a process may be allowed
+ *
+ * @return uint64_t fs.nr_open, RLIMIT_UNLIMITED when unknown
+ */
+static uint64_t read_nr_open(void)
+{
+    unsigned long long nr_open;
+
+    FILE *fp = fopen("/proc/sys/fs/nr_open", "re");
+    if (!fp)
+    {
+        return RLIMIT_UNLIMITED;
+    }
+
+    if (fscanf(fp, "%llu", &nr_open) != 1)
+    {
+        nr_open = RLIMIT_UNLIMITED;
+    }
+
+    fclose(fp);
+
+    return nr_open;
+}
+
+/**
+ * @brief Parse resource limit
+ *
+ * A resource given again replaces its previous limit.
+ *
+ * @param opt option
+ * @param limit_str format: NAME=SOFT[:HARD]
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_rlimit(option_t *opt, const char *limit_str)
+{
+    char name[32];
+    char soft_str[32];
+    const char *sep;
+    const char *hard_str;
+    rlimit_spec_t spec;
+    size_t i;
+
+    if (!limit_str)
+    {
+        return 0;
+    }
+
+    sep = strchr(limit_str, '=');
+    if (!sep || (size_t)(sep - limit_str) >= sizeof(name))
+    {
+        log_error("failed to parse rlimit '%s': expected NAME=SOFT[:HARD]", limit_str);
+        return -1;
+    }
+
+    memcpy(name, limit_str, sep - limit_str);
+    name[sep - limit_str] = '\0';
+
+    const char *res_name = strncasecmp(name, "RLIMIT_", 7) == 0 ? name + 7 : name;
+
+    for (i = 0; i < sizeof(rlimit_names) / sizeof(rlimit_names[0]); i++)
+    {
+        if (strcasecmp(res_name, rlimit_names[i].name) == 0)
+        {
+            break;
+        }
+    }
+
+    if (i == sizeof(rlimit_names) / sizeof(rlimit_names[0]))
+    {
+        log_error("failed to parse rlimit '%s': expected NOFILE, MEMLOCK, CORE, NPROC or STACK", limit_str);
+        return -1;
+    }
+
+    spec.resource = rlimit_names[i].resource;
+
+    hard_str = strchr(sep + 1, ':');
+    size_t soft_len = hard_str ? (size_t)(hard_str - sep - 1) : strlen(sep + 1);
+    if (soft_len >= sizeof(soft_str))
+    {
+        log_error("failed to parse rlimit '%s': invalid soft limit", limit_str);
+        return -1;
+    }
+
+    memcpy(soft_str, sep + 1, soft_len);
+    soft_str[soft_len] = '\0';
+
+    if (parse_rlimit_value(soft_str, &spec.soft) < 0)
+    {
+        log_error("failed to parse rlimit '%s': invalid soft limit", limit_str);
+        return -1;
+    }
+
+    spec.hard = spec.soft;
+    if (hard_str && parse_rlimit_value(hard_str + 1, &spec.hard) < 0)
+    {
+        log_error("failed to parse rlimit '%s': invalid hard limit", limit_str);
+        return -1;
+    }
+
+    if (spec.soft > spec.hard)
+    {
+        log_error("failed to parse rlimit '%s': soft limit exceeds hard limit", limit_str);
+        return -1;
+    }
+
+    if (spec.resource == RLIMIT_NOFILE)
+    {
+        // setrlimit() refuses more open files than fs.nr_open, even to root
+        uint64_t nr_open = read_nr_open();
+
+        if (spec.hard > nr_open)
+        {
+            log_error("failed to parse rlimit '%s': exceeds fs.nr_open %llu", limit_str, (unsigned long long)nr_open);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < (size_t)opt->rlimit_cnt; i++)
+    {
+        if (opt->rlimits[i].resource == spec.resource)
+        {
+            break;
+        }
+    }
+
+    opt->rlimits[i] = spec;
+    if (i == (size_t)opt->rlimit_cnt)
+    {
+        opt->rlimit_cnt++;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse CPU load rebalancing
+ *
+ * @param opt option
+ * @param rebalance_str format: DURATION[:MOVES]
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_rebalance(option_t *opt, const char *rebalance_str)
+{
+    char interval_str[32];
+    const char *moves_str = strchr(rebalance_str, ':');
+    size_t len = moves_str ? (size_t)(moves_str - rebalance_str) : strlen(rebalance_str);
+    uint64_t interval_ms;
+
+    if (len >= sizeof(interval_str))
+    {
+        log_error("failed to parse rebalance '%s': invalid interval", rebalance_str);
+        return -1;
+    }
+
+    memcpy(interval_str, rebalance_str, len);
+    interval_str[len] = '\0';
+
+    if (parse_duration(interval_str, &interval_ms) < 0 || interval_ms < REBALANCE_MIN_MS)
+    {
+        log_error("failed to parse rebalance '%s': interval must be at least %d ms", rebalance_str, REBALANCE_MIN_MS);
+        return -1;
+    }
+
+    if (moves_str && parse_int_range("rebalance moves", moves_str + 1, 1, MAX_REBALANCE_MOVES, false,
+                                     &opt->rebalance_moves) < 0)
+    {
+        return -1;
+    }
+
+    opt->rebalance_ms = interval_ms;
+
+    return 0;
+}
+
+/**
+ * @brief Parse control socket path
  *
  * @param opt option
  * @param file file path
@@ -494,9 +2260,9 @@ static int parse_user(option_t *opt, const char *user_str)
  * @retval `0` ok
  * @retval `-1` failed
  */
-static int parse_pid_file(option_t *opt, const char *file)
+static int parse_control_file(option_t *opt, const char *file)
 {
-    return general_parse_file(&opt->pid_file, file);
+    return general_parse_file(&opt->control_file, file);
 }
 
 /**
@@ -604,14 +2370,426 @@ void free_option(option_t *opt)
         opt->pid_file = NULL;
     }
 
+    if (opt->config_file)
+    {
+        free(opt->config_file);
+        opt->config_file = NULL;
+    }
+
+    if (opt->control_file)
+    {
+        free(opt->control_file);
+        opt->control_file = NULL;
+    }
+
+    // the plan removes the cgroup by its path, not the root
+    free(opt->cgroup_root);
+    opt->cgroup_root = NULL;
+
     memset(opt->respawn_code_bits, 0, sizeof(opt->respawn_code_bits));
+    opt->respawn_code_set = false;
+
+    // the plan closes the listeners by their specs
+    spawn_plan_free(&opt->plan, opt);
+
+    if (opt->listens)
+    {
+        for (size_t i = 0; i < opt->listen_cnt; i++)
+        {
+            free(opt->listens[i]);
+        }
+
+        free(opt->listens);
+        opt->listens = NULL;
+        opt->listen_cnt = 0;
+    }
 
     opt->respawn = false;
+    opt->stop_stage_cnt = 0;
+    opt->exec_by_path = false;
+    opt->notify = false;
+
+    free(opt->health_arg);
+    opt->health_arg = NULL;
+    opt->health_probe = HEALTH_PROBE_NONE;
+    opt->replica_cnt = 1;
+    opt->name = NULL;
     opt->target = NULL;
     opt->target_argc = 0;
     opt->target_argv = NULL;
 }
 
+/**
+ * @brief Parse config file path
+ *
+ * @param opt option
+ * @param file file path
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int parse_config_file(option_t *opt, const char *file)
+{
+    char *path = realpath(file, NULL);
+    if (!path)
+    {
+        log_error("%s: %s", file, strerror(errno));
+        return -1;
+    }
+
+    if (opt->config_file)
+    {
+        free(opt->config_file);
+    }
+
+    opt->config_file = path;
+
+    return 0;
+}
+
+/**
+ * @brief Apply a service option
+ *
+ * Shared by the command line and the config file.
+ *
+ * @param opt option
+ * @param id option ID
+ * @param arg option argument, NULL for options without argument
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int apply_option(option_t *opt, int id, const char *arg)
+{
+    int rc = 0;
+
+    switch (id)
+    {
+    case OPT_STDOUT:
+        rc = parse_stdout_file(opt, arg);
+        break;
+
+    case OPT_STDERR:
+        rc = parse_stderr_file(opt, arg);
+        break;
+
+    case OPT_CHDIR:
+        rc = parse_working_dir(opt, arg);
+        break;
+
+    case OPT_USER:
+        rc = parse_user(opt, arg);
+        break;
+
+    case OPT_ENV:
+        rc = append_env(opt, arg);
+        break;
+
+    case OPT_RESPAWN:
+        opt->respawn = true;
+        break;
+
+    case OPT_RESPAWN_CODE:
+        if (!opt->respawn_code_set)
+        {
+            // clear default values
+            memset(opt->respawn_code_bits, 0, sizeof(opt->respawn_code_bits));
+            opt->respawn_code_set = true;
+        }
+        rc = parse_respawn_code(opt, arg);
+        break;
+
+    case OPT_RESPAWN_DELAY:
+        rc = parse_respawn_delay(opt, arg);
+        break;
+
+    case OPT_RESPAWN_BACKOFF:
+        rc = parse_respawn_backoff(opt, arg);
+        break;
+
+    case OPT_RESPAWN_MAX_DELAY:
+        rc = parse_respawn_max_delay(opt, arg);
+        break;
+
+    case OPT_RESPAWN_JITTER:
+        rc = parse_respawn_jitter(opt, arg);
+        break;
+
+    case OPT_RESPAWN_RESET_AFTER:
+        rc = parse_respawn_reset_after(opt, arg);
+        break;
+
+    case OPT_RESPAWN_LIMIT:
+        rc = parse_respawn_limit(opt, arg);
+        break;
+
+    case OPT_RESPAWN_COOLDOWN:
+        rc = parse_respawn_cooldown(opt, arg);
+        break;
+
+    case OPT_MAX_RESPAWNS:
+        rc = parse_max_respawn_count(opt, arg);
+        break;
+
+    case OPT_STOP_SIGNAL:
+        rc = parse_stop_signal(opt, arg);
+        break;
+
+    case OPT_STOP_TIMEOUT:
+        rc = parse_stop_timeout(opt, arg);
+        break;
+
+    case OPT_STOP_SEQUENCE:
+        rc = parse_stop_sequence(opt, arg);
+        break;
+
+    case OPT_KILL_MODE:
+        rc = parse_kill_mode(opt, arg);
+        break;
+
+    case OPT_SPAWN:
+        rc = parse_spawn_backend(opt, arg);
+        break;
+
+    case OPT_EXEC_BY_PATH:
+        opt->exec_by_path = true;
+        break;
+
+    case OPT_REPLICAS:
+        rc = parse_replica_count(opt, arg);
+        break;
+
+    case OPT_READY_FD:
+        rc = parse_ready_fd(opt, arg);
+        break;
+
+    case OPT_READY_TIMEOUT:
+        rc = parse_ready_timeout(opt, arg);
+        break;
+
+    case OPT_LISTEN:
+        rc = append_listen(opt, arg);
+        break;
+
+    case OPT_NOTIFY:
+        opt->notify = true;
+        break;
+
+    case OPT_WATCHDOG:
+        rc = parse_watchdog(opt, arg);
+        break;
+
+    case OPT_HEALTH_CMD:
+        rc = parse_health_probe(opt, HEALTH_PROBE_CMD, arg);
+        break;
+
+    case OPT_HEALTH_TCP:
+        rc = parse_health_probe(opt, HEALTH_PROBE_TCP, arg);
+        break;
+
+    case OPT_HEALTH_UNIX:
+        rc = parse_health_probe(opt, HEALTH_PROBE_UNIX, arg);
+        break;
+
+    case OPT_HEALTH_INTERVAL:
+        rc = parse_health_duration("health interval", arg, &opt->health_interval_ms);
+        break;
+
+    case OPT_HEALTH_TIMEOUT:
+        rc = parse_health_duration("health timeout", arg, &opt->health_timeout_ms);
+        break;
+
+    case OPT_HEALTH_RETRIES:
+        rc = parse_health_retries(opt, arg);
+        break;
+
+    case OPT_RESTART_ON_P99:
+        rc = parse_health_duration("p99 latency limit", arg, &opt->restart_p99_ms);
+        break;
+
+    case OPT_MAX_RSS:
+        rc = parse_max_rss(opt, arg);
+        break;
+
+    case OPT_MAX_CPU_PERCENT:
+        rc = parse_max_cpu_percent(opt, arg);
+        break;
+
+    case OPT_RECYCLE_HORIZON:
+        rc = parse_recycle_horizon(opt, arg);
+        break;
+
+    case OPT_CGROUP:
+        rc = parse_cgroup_root(opt, arg);
+        break;
+
+    case OPT_MEMORY_MAX:
+        rc = parse_cgroup_size("memory max", arg, &opt->memory_max_bytes);
+        break;
+
+    case OPT_MEMORY_HIGH:
+        rc = parse_cgroup_size("memory high", arg, &opt->memory_high_bytes);
+        break;
+
+    case OPT_CPU_MAX:
+        rc = parse_int_range("cpu max", arg, 1, MAX_CPU_PERCENT, true, &opt->cpu_max_percent);
+        break;
+
+    case OPT_CPU_WEIGHT:
+        rc = parse_int_range("cpu weight", arg, MIN_CGROUP_WEIGHT, MAX_CGROUP_WEIGHT, false, &opt->cpu_weight);
+        break;
+
+    case OPT_IO_WEIGHT:
+        rc = parse_int_range("io weight", arg, MIN_CGROUP_WEIGHT, MAX_CGROUP_WEIGHT, false, &opt->io_weight);
+        break;
+
+    case OPT_PIDS_MAX:
+        rc = parse_int_range("pids max", arg, 1, INT_MAX, false, &opt->pids_max);
+        break;
+
+    case OPT_CPUS:
+        rc = parse_cpus(opt, arg);
+        break;
+
+    case OPT_NUMA_NODE:
+        rc = parse_numa_node(opt, arg);
+        break;
+
+    case OPT_NICE:
+        rc = parse_int_range("nice", arg, MIN_NICE, MAX_NICE, false, &opt->nice);
+        break;
+
+    case OPT_SCHED:
+        rc = parse_sched(opt, arg);
+        break;
+
+    case OPT_IOCLASS:
+        rc = parse_ioclass(opt, arg);
+        break;
+
+    case OPT_OOM_SCORE_ADJ:
+        rc = parse_int_range("oom score adj", arg, MIN_OOM_SCORE_ADJ, MAX_OOM_SCORE_ADJ, false, &opt->oom_score_adj);
+        break;
+
+    case OPT_RLIMIT:
+        rc = parse_rlimit(opt, arg);
+        break;
+
+    default:
+        rc = -1;
+        break;
+    }
+
+    return rc;
+}
+
+/**
+ * @brief Set a service option by its long name, used by the config file
+ *
+ * Options without argument take a boolean value: yes, true, on or 1 to
+ * enable them, no, false, off or 0 to keep them disabled.
+ *
+ * @param opt option
+ * @param name long option name, e.g. "respawn-delay"
+ * @param value option value
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int set_option(option_t *opt, const char *name, const char *value)
+{
+    const struct option *lo = NULL;
+
+    for (size_t i = 0; long_opts[i].name; i++)
+    {
+        if (strcmp(long_opts[i].name, name) == 0)
+        {
+            lo = &long_opts[i];
+            break;
+        }
+    }
+
+    // options of rund itself are only accepted on the command line
+    if (!lo || lo->val == OPT_PIDFILE || lo->val == OPT_CONFIG || lo->val == OPT_CONTROL ||
+        lo->val == OPT_SUBREAPER || lo->val == OPT_REBALANCE || lo->val == OPT_HELP || lo->val == OPT_VERSION)
+    {
+        log_error("error: unknown option '%s'", name);
+        return -1;
+    }
+
+    if (lo->has_arg == no_argument)
+    {
+        if (strcasecmp(value, "yes") == 0 || strcasecmp(value, "true") == 0 ||
+            strcasecmp(value, "on") == 0 || strcmp(value, "1") == 0)
+        {
+            return apply_option(opt, lo->val, NULL);
+        }
+
+        if (strcasecmp(value, "no") == 0 || strcasecmp(value, "false") == 0 ||
+            strcasecmp(value, "off") == 0 || strcmp(value, "0") == 0)
+        {
+            return 0;
+        }
+
+        log_error("error: option '%s' expects a boolean, got '%s'", name, value);
+        return -1;
+    }
+
+    return apply_option(opt, lo->val, value);
+}
+
+/**
+ * @brief Validate the target and build the spawn plan once all options are set
+ *
+ * @param opt option, `target` and `target_argv` should be set
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int finalize_option(option_t *opt)
+{
+    int rc = check_target(opt->target);
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    finalize_stop_sequence(opt);
+
+    if (opt->ready_fd >= 0 && opt->ready_fd < LISTEN_FDS_START + (int)opt->listen_cnt)
+    {
+        log_error("error: ready fd %d is taken by a listener", opt->ready_fd);
+        return -1;
+    }
+
+    if (opt->restart_p99_ms > 0 && opt->health_probe == HEALTH_PROBE_NONE)
+    {
+        log_error("error: --restart-on-p99 requires a health probe");
+        return -1;
+    }
+
+    if (opt->recycle_horizon_ms > 0 && opt->max_rss_bytes == 0)
+    {
+        log_error("error: --recycle-horizon requires --max-rss");
+        return -1;
+    }
+
+    if (!opt->cgroup_root && (opt->memory_max_bytes > 0 || opt->memory_high_bytes > 0 || opt->cpu_max_percent > 0 ||
+                              opt->cpu_weight > 0 || opt->io_weight > 0 || opt->pids_max > 0))
+    {
+        log_error("error: cgroup limits require --cgroup");
+        return -1;
+    }
+
+    if (opt->kill_mode == KILL_MODE_CGROUP && !opt->cgroup_root)
+    {
+        log_error("error: --kill-mode=cgroup requires --cgroup");
+        return -1;
+    }
+
+    return spawn_plan_init(&opt->plan, opt);
+}
+
 /**
  * @brief Parse option
  *
@@ -628,7 +2806,7 @@ int parse_option(int argc, char **argv, option_t *opt)
     int rc;
     int cur;
     char *prog_name = basename(argv[0]);
-    bool has_respawn_code = false;
+    bool has_service_opt = false;
 
     while ((cur = getopt_long(argc, argv, short_opts, long_opts, NULL)) != EOF)
     {
@@ -636,50 +2814,24 @@ int parse_option(int argc, char **argv, option_t *opt)
 
         switch (cur)
         {
-        case OPT_STDOUT:
-            rc = parse_stdout_file(opt, optarg);
-            break;
-
-        case OPT_STDERR:
-            rc = parse_stderr_file(opt, optarg);
-            break;
-
-        case OPT_CHDIR:
-            rc = parse_working_dir(opt, optarg);
-            break;
-
-        case OPT_USER:
-            rc = parse_user(opt, optarg);
-            break;
-
-        case OPT_ENV:
-            rc = append_env(opt, optarg);
-            break;
-
         case OPT_PIDFILE:
             rc = parse_pid_file(opt, optarg);
             break;
 
-        case OPT_RESPAWN:
-            opt->respawn = true;
+        case OPT_CONFIG:
+            rc = parse_config_file(opt, optarg);
             break;
 
-        case OPT_RESPAWN_CODE:
-            if (!has_respawn_code)
-            {
-                // clear default values
-                memset(opt->respawn_code_bits, 0, sizeof(opt->respawn_code_bits));
-                has_respawn_code = true;
-            }
-            rc = parse_respawn_code(opt, optarg);
+        case OPT_CONTROL:
+            rc = parse_control_file(opt, optarg);
             break;
 
-        case OPT_RESPAWN_DELAY:
-            rc = parse_respawn_delay(opt, optarg);
+        case OPT_SUBREAPER:
+            opt->subreaper = true;
             break;
 
-        case OPT_MAX_RESPAWNS:
-            rc = parse_max_respawn_count(opt, optarg);
+        case OPT_REBALANCE:
+            rc = parse_rebalance(opt, optarg);
             break;
 
         case OPT_VERSION:
@@ -692,10 +2844,15 @@ int parse_option(int argc, char **argv, option_t *opt)
             return 0;
             break;
 
-        default:
+        case '?':
             show_usage(stderr, prog_name);
             rc = -1;
             break;
+
+        default:
+            rc = apply_option(opt, cur, optarg);
+            has_service_opt = true;
+            break;
         }
 
         if (rc < 0)
@@ -704,6 +2861,19 @@ int parse_option(int argc, char **argv, option_t *opt)
         }
     }
 
+    if (opt->config_file)
+    {
+        // services are defined in the config file
+        if (has_service_opt || optind < argc)
+        {
+            log_error("error: the target and its options must be given in the config file when --config is used");
+            show_usage(stderr, prog_name);
+            return -1;
+        }
+
+        return 1;
+    }
+
     if (optind >= argc)
     {
         log_error("error: missing target program");
@@ -711,15 +2881,15 @@ int parse_option(int argc, char **argv, option_t *opt)
         return -1;
     }
 
-    rc = check_target(argv[optind]);
+    opt->target = argv[optind];
+    opt->target_argc = argc - optind;
+    opt->target_argv = &argv[optind];
+
+    rc = finalize_option(opt);
     if (rc < 0)
     {
         return rc;
     }
 
-    opt->target = argv[optind];
-    opt->target_argc = argc - optind;
-    opt->target_argv = &argv[optind];
-
     return 1;
 }
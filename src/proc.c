@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file proc.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ * 2026-10-15   Frank <uuidxx@163.com>          index watched processes by pid
+ * 2026-10-15   Frank <uuidxx@163.com>          reap orphaned descendants as subreaper
+ *
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// Whether the running kernel supports pidfd_open(), probed on first use
+static enum {
+    PIDFD_UNKNOWN,
+    PIDFD_SUPPORTED,
+    PIDFD_UNSUPPORTED,
+} pidfd_support = PIDFD_UNKNOWN;
+
+// Handler of the orphans reaped as subreaper, NULL unless subreaper
+static proc_stray_handler_t stray_handler = NULL;
+
+// Initial number of buckets of the pid table, must be a power of 2
+#define PROC_TABLE_INIT_SIZE 64
+
+// Watched processes indexed by pid, chained through `proc_t.next`
+static proc_t **proc_table = NULL;
+static size_t proc_table_size = 0;
+static size_t proc_cnt = 0;
+
+/**
+ * @brief Get the bucket of a pid
+ *
+ * @param pid process ID
+ * @param size number of buckets
+ * @return size_t bucket index
+ */
+static size_t proc_bucket(pid_t pid, size_t size)
+{
+    // Fibonacci hashing spreads sequential pids over the buckets
+    return ((uint32_t)pid * 2654435769U) & (size - 1);
+}
+
+/**
+ * @brief Grow the pid table when it becomes too dense
+ *
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int proc_table_grow(void)
+{
+    if (proc_cnt < proc_table_size)
+    {
+        return 0;
+    }
+
+    size_t size = proc_table_size ? proc_table_size * 2 : PROC_TABLE_INIT_SIZE;
+    proc_t **table = calloc(size, sizeof(proc_t *));
+    if (!table)
+    {
+        log_error("failed to calloc: %s", strerror(errno));
+        return -1;
+    }
+
+    for (size_t i = 0; i < proc_table_size; i++)
+    {
+        proc_t *proc = proc_table[i];
+        while (proc)
+        {
+            proc_t *next = proc->next;
+            size_t idx = proc_bucket(proc->pid, size);
+
+            proc->next = table[idx];
+            table[idx] = proc;
+            proc = next;
+        }
+    }
+
+    free(proc_table);
+    proc_table = table;
+    proc_table_size = size;
+
+    return 0;
+}
+
+/**
+ * @brief Find a watched process by pid
+ *
+ * @param pid process ID
+ * @return proc_t*
+ * @retval `proc` watched process
+ * @retval `NULL` not found
+ */
+proc_t *proc_find(pid_t pid)
+{
+    if (!proc_table)
+    {
+        return NULL;
+    }
+
+    for (proc_t *proc = proc_table[proc_bucket(pid, proc_table_size)]; proc; proc = proc->next)
+    {
+        if (proc->pid == pid)
+        {
+            return proc;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Obtain a file descriptor that refers to a process
+ *
+ * @param pid process ID
+ * @return int
+ * @retval `fd` pidfd on success
+ * @retval `-1` failed
+ */
+static int pidfd_open(pid_t pid)
+{
+    return syscall(SYS_pidfd_open, pid, 0);
+}
+
+/**
+ * @brief Deliver the exit status of a watched process to its handler
+ *
+ * @param proc process
+ * @param status status from waitpid()
+ */
+static void proc_exited(proc_t *proc, int status)
+{
+    proc_unwatch(proc);
+
+    if (proc->on_exit)
+    {
+        proc->on_exit(proc, status);
+    }
+}
+
+/**
+ * @brief Handle pidfd readiness, which means the process has terminated
+ *
+ * @param ev event
+ * @param events ready events
+ */
+static void pidfd_handler(event_t *ev, uint32_t events)
+{
+    proc_t *proc = ev->data;
+    int status;
+
+    pid_t rc = waitpid(proc->pid, &status, WNOHANG);
+    if (rc == proc->pid)
+    {
+        proc_exited(proc, status);
+    }
+    else if (rc < 0 && errno == ECHILD)
+    {
+        // already reaped elsewhere, nothing to report
+        proc_unwatch(proc);
+    }
+}
+
+/**
+ * @brief Watch a child process for termination
+ *
+ * A pidfd is registered to the event loop when the kernel supports it, so the
+ * exit shows up as a readable fd. Otherwise the process is reaped by
+ * `proc_reap()` when SIGCHLD is received. Either way the process is indexed
+ * in the pid table.
+ *
+ * @param proc process, `on_exit` should be set
+ * @param pid process ID of the child
+ * @param pidfd pidfd of the child obtained at spawn time, -1 to open one;
+ *              owned by the watcher afterwards
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int proc_watch(proc_t *proc, pid_t pid, int pidfd)
+{
+    proc->pid = pid;
+    proc->pidfd = -1;
+    proc->next = NULL;
+
+    if (proc_table_grow() < 0)
+    {
+        if (pidfd >= 0)
+        {
+            close(pidfd);
+        }
+        return -1;
+    }
+
+    if (pidfd_support != PIDFD_UNSUPPORTED)
+    {
+        int fd = pidfd >= 0 ? pidfd : pidfd_open(pid);
+        if (fd >= 0)
+        {
+            pidfd_support = PIDFD_SUPPORTED;
+
+            proc->pidfd = fd;
+            proc->event.fd = fd;
+            proc->event.handler = pidfd_handler;
+            proc->event.data = proc;
+
+            if (event_add(&proc->event, EPOLLIN) < 0)
+            {
+                close(fd);
+                proc->pidfd = -1;
+                proc->event.fd = -1;
+                return -1;
+            }
+        }
+        else if (errno != ENOSYS)
+        {
+            log_error("failed to open pidfd of %d: %s", pid, strerror(errno));
+            return -1;
+        }
+        else
+        {
+            log_info("pidfd is not supported, falling back to waitpid");
+            pidfd_support = PIDFD_UNSUPPORTED;
+        }
+    }
+
+    size_t idx = proc_bucket(pid, proc_table_size);
+
+    proc->next = proc_table[idx];
+    proc_table[idx] = proc;
+    proc_cnt++;
+
+    return 0;
+}
+
+/**
+ * @brief Stop watching a process
+ *
+ * @param proc process
+ */
+void proc_unwatch(proc_t *proc)
+{
+    if (proc->pidfd >= 0)
+    {
+        event_del(&proc->event);
+        close(proc->pidfd);
+        proc->pidfd = -1;
+        proc->event.fd = -1;
+    }
+
+    if (!proc_table)
+    {
+        return;
+    }
+
+    for (proc_t **pp = &proc_table[proc_bucket(proc->pid, proc_table_size)]; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == proc)
+        {
+            *pp = proc->next;
+            proc->next = NULL;
+            proc_cnt--;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Become the subreaper of the descendants of rund
+ *
+ * Orphans of the targets are then re-parented to rund instead of init, and
+ * reaped by `proc_reap()`.
+ *
+ * @param on_stray handler of the reaped descendants that are not watched
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int proc_subreaper_init(proc_stray_handler_t on_stray)
+{
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0)
+    {
+        log_error("failed to become child subreaper: %s", strerror(errno));
+        return -1;
+    }
+
+    stray_handler = on_stray;
+
+    return 0;
+}
+
+/**
+ * @brief Convert the siginfo of a terminated child to a waitpid() status
+ *
+ * @param info siginfo from waitid()
+ * @return int
+ */
+static int wait_status(const siginfo_t *info)
+{
+    switch (info->si_code)
+    {
+    case CLD_EXITED:
+        return (info->si_status & 0xff) << 8;
+
+    case CLD_DUMPED:
+        return (info->si_status & 0x7f) | 0x80;
+
+    default:
+        return info->si_status & 0x7f;
+    }
+}
+
+/**
+ * @brief Reap terminated children that are watched without a pidfd, and
+ * every child as subreaper
+ *
+ * Should be called whenever SIGCHLD is received, SIGCHLD being coalesced,
+ * it reaps until no terminated child is left. It is a no-op when every
+ * process is watched through a pidfd and rund is not a subreaper.
+ *
+ */
+void proc_reap(void)
+{
+    siginfo_t info;
+
+    if (pidfd_support == PIDFD_SUPPORTED && !stray_handler)
+    {
+        return;
+    }
+
+    while (1)
+    {
+        // peeked first, an orphan still has its session until it is reaped
+        info.si_pid = 0;
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0 || info.si_pid == 0)
+        {
+            break;
+        }
+
+        pid_t pid = info.si_pid;
+        proc_t *proc = proc_find(pid);
+        pid_t sid = proc ? -1 : getsid(pid);
+
+        if (waitid(P_PID, pid, &info, WEXITED | WNOHANG) < 0 || info.si_pid != pid)
+        {
+            break;
+        }
+
+        if (proc)
+        {
+            proc_exited(proc, wait_status(&info));
+        }
+        else if (stray_handler)
+        {
+            stray_handler(pid, sid, wait_status(&info));
+        }
+    }
+}
+
+/**
+ * @brief Release the pid table
+ *
+ */
+void proc_cleanup(void)
+{
+    free(proc_table);
+    proc_table = NULL;
+    proc_table_size = 0;
+    proc_cnt = 0;
+}
@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file resource.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ * 2026-10-15   Frank <uuidxx@163.com>          add RSS trend
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+// Enough for /proc/PID/stat up to the rss field, whatever the command name
+#define RESOURCE_STAT_MAX 512
+
+static long clock_ticks = 0;
+static long page_size = 0;
+
+/**
+ * @brief Open the proc file of a process the samples are read from
+ *
+ * The file stays open for the life of the process, so that a sample is a
+ * single pread(). /proc/PID/statm is enough for the RSS, /proc/PID/stat
+ * holds the CPU time as well. The pid cannot be reused while the process
+ * is not reaped.
+ *
+ * @param sampler sampler
+ * @param pid process id
+ * @param cpu whether the CPU time is sampled
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int resource_sampler_open(resource_sampler_t *sampler, pid_t pid, bool cpu)
+{
+    char path[64];
+
+    if (clock_ticks == 0)
+    {
+        clock_ticks = sysconf(_SC_CLK_TCK);
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, cpu ? "stat" : "statm");
+
+    sampler->cpu = cpu;
+    sampler->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (sampler->fd < 0)
+    {
+        log_error("failed to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Sample the resource usage of a process
+ *
+ * @param sampler sampler, opened
+ * @param rss_bytes buffer to store the resident set size
+ * @param cpu_us buffer to store the user and system CPU time, 0 when the
+ * CPU time is not sampled
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int resource_sampler_read(resource_sampler_t *sampler, uint64_t *rss_bytes, uint64_t *cpu_us)
+{
+    char buf[RESOURCE_STAT_MAX];
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    long rss = 0;
+
+    ssize_t len = pread(sampler->fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+    {
+        return -1;
+    }
+    buf[len] = '\0';
+
+    if (sampler->cpu)
+    {
+        // the command name in parentheses may contain anything, skip past it
+        char *fields = strrchr(buf, ')');
+
+        if (!fields || sscanf(fields + 1,
+                              " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu"
+                              " %*d %*d %*d %*d %*d %*d %*u %*u %ld",
+                              &utime,
+                              &stime,
+                              &rss) != 3)
+        {
+            return -1;
+        }
+    }
+    else if (sscanf(buf, "%*u %ld", &rss) != 1)
+    {
+        return -1;
+    }
+
+    *rss_bytes = rss > 0 ? (uint64_t)rss * page_size : 0;
+    *cpu_us = ((uint64_t)utime + stime) * 1000000 / clock_ticks;
+
+    return 0;
+}
+
+/**
+ * @brief Close the proc file of a sampler
+ *
+ * @param sampler sampler
+ */
+void resource_sampler_close(resource_sampler_t *sampler)
+{
+    if (sampler->fd >= 0)
+    {
+        close(sampler->fd);
+        sampler->fd = -1;
+    }
+}
+
+/**
+ * @brief Forget the samples of a trend
+ *
+ * @param trend trend
+ */
+void rss_trend_reset(rss_trend_t *trend)
+{
+    trend->head = 0;
+    trend->cnt = 0;
+}
+
+/**
+ * @brief Add a sample to a trend, replacing the oldest one when full
+ *
+ * @param trend trend
+ * @param ms sample time
+ * @param bytes RSS
+ */
+void rss_trend_add(rss_trend_t *trend, uint64_t ms, uint64_t bytes)
+{
+    rss_sample_t *sample;
+
+    if (trend->cnt == RSS_TREND_SAMPLES)
+    {
+        sample = &trend->samples[trend->head];
+        trend->head = (trend->head + 1) % RSS_TREND_SAMPLES;
+    }
+    else
+    {
+        sample = &trend->samples[(trend->head + trend->cnt) % RSS_TREND_SAMPLES];
+        trend->cnt++;
+    }
+
+    sample->ms = ms;
+    sample->bytes = bytes;
+}
+
+/**
+ * @brief Project when the RSS reaches a limit
+ *
+ * Fits a least-squares line over the samples. Times are taken relative to
+ * the newest sample, which keeps the sums small whatever the uptime.
+ *
+ * @param trend trend
+ * @param limit_bytes RSS limit
+ * @param eta_ms buffer to store the time from the newest sample until the
+ * fitted line reaches the limit
+ * @param bytes_per_s buffer to store the slope of the fitted line
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` too few samples, or the RSS is not growing
+ */
+int rss_trend_eta(const rss_trend_t *trend, uint64_t limit_bytes, uint64_t *eta_ms, double *bytes_per_s)
+{
+    const rss_sample_t *newest = &trend->samples[(trend->head + trend->cnt - 1) % RSS_TREND_SAMPLES];
+    double sum_x = 0;
+    double sum_y = 0;
+    double sum_xx = 0;
+    double sum_xy = 0;
+
+    if (trend->cnt < RSS_TREND_MIN_SAMPLES)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < trend->cnt; i++)
+    {
+        const rss_sample_t *sample = &trend->samples[(trend->head + i) % RSS_TREND_SAMPLES];
+        double x = ((double)sample->ms - (double)newest->ms) / 1000;
+        double y = sample->bytes;
+
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+    }
+
+    double n = trend->cnt;
+    double denom = n * sum_xx - sum_x * sum_x;
+    if (denom <= 0)
+    {
+        return -1;
+    }
+
+    double slope = (n * sum_xy - sum_x * sum_y) / denom;
+    if (slope <= 0)
+    {
+        return -1;
+    }
+
+    // fitted RSS at the newest sample, where x is 0
+    double fitted = (sum_y - slope * sum_x) / n;
+
+    *bytes_per_s = slope;
+    *eta_ms = fitted >= (double)limit_bytes ? 0 : (uint64_t)(((double)limit_bytes - fitted) / slope * 1000);
+
+    return 0;
+}
@@ -0,0 +1,1592 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file spawn.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ * 2026-10-15   Frank <uuidxx@163.com>          resolve the spawn plan once at parse time
+ * 2026-10-15   Frank <uuidxx@163.com>          execute the target through a cached O_PATH descriptor
+ * 2026-10-15   Frank <uuidxx@163.com>          add per replica environment and log files
+ * 2026-10-15   Frank <uuidxx@163.com>          pass the readiness pipe to the target
+ * 2026-10-15   Frank <uuidxx@163.com>          pass listeners with LISTEN_FDS
+ * 2026-10-15   Frank <uuidxx@163.com>          set NOTIFY_SOCKET
+ * 2026-10-15   Frank <uuidxx@163.com>          set WATCHDOG_USEC and WATCHDOG_PID
+ * 2026-10-15   Frank <uuidxx@163.com>          spawn health probe commands
+ * 2026-10-15   Frank <uuidxx@163.com>          spawn children into the cgroup of the service
+ * 2026-10-15   Frank <uuidxx@163.com>          spawn targets into the cgroup of their slot
+ * 2026-10-16   Frank <uuidxx@163.com>          apply CPU affinity and NUMA memory policy
+ * 2026-10-16   Frank <uuidxx@163.com>          track the core of each replica for rebalancing
+ * 2026-10-16   Frank <uuidxx@163.com>          apply scheduling, IO priority and OOM score adjustment
+ * 2026-10-16   Frank <uuidxx@163.com>          apply resource limits
+ * 2026-10-16   Frank <uuidxx@163.com>          open listeners once the pid file is locked
+ * 2026-10-16   Frank <uuidxx@163.com>          create the cgroup once the pid file is locked
+ * 2026-10-16   Frank <uuidxx@163.com>          share the address space of the parent with the clone3 backend
+ * 2026-10-16   Frank <uuidxx@163.com>          spawn into the cgroup with clone3 in the vfork backend
+ * 2026-10-16   Frank <uuidxx@163.com>          close the OOM score adjustment file on write errors
+ * 2026-10-16   Frank <uuidxx@163.com>          reap children failing before exec and report the spawn failed
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <limits.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+// ioprio_set() has no glibc wrapper
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+
+#ifndef SYS_execveat
+#define SYS_execveat 322
+#endif
+
+#ifndef AT_EMPTY_PATH
+#define AT_EMPTY_PATH 0x1000
+#endif
+
+// Prefixes of the LISTEN_PID and WATCHDOG_PID entries, the child appends its pid
+#define LISTEN_PID_PREFIX   "LISTEN_PID="
+#define WATCHDOG_PID_PREFIX "WATCHDOG_PID="
+
+// Stack used by the child of the vfork and clone3 backends until it calls execve()
+#define SPAWN_STACK_SIZE (256 * 1024)
+
+extern char **environ;
+
+// Arguments of clone3(), see struct clone_args in <linux/sched.h>
+struct spawn_clone_args
+{
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+// Size of the first version of struct clone_args, without set_tid and cgroup,
+// accepted by every kernel with clone3()
+#define SPAWN_CLONE_ARGS_SIZE_VER0 64
+
+// Steps of the child setup that may fail, reported to the parent
+enum SPAWN_STEP
+{
+    SPAWN_STEP_CGROUP,
+    SPAWN_STEP_AFFINITY,
+    SPAWN_STEP_MEMPOLICY,
+    SPAWN_STEP_SCHED,
+    SPAWN_STEP_NICE,
+    SPAWN_STEP_IOPRIO,
+    SPAWN_STEP_OOM_SCORE_ADJ,
+    SPAWN_STEP_RLIMIT,
+    SPAWN_STEP_GROUPS,
+    SPAWN_STEP_GID,
+    SPAWN_STEP_UID,
+    SPAWN_STEP_EXEC,
+};
+
+// Failure report written by the child to the error pipe
+typedef struct
+{
+    int step;
+    int err;
+} spawn_report_t;
+
+// Arguments of the child, which may share the address space of the parent
+typedef struct
+{
+    const option_t *opt;
+    const spawn_plan_t *plan;
+    const spawn_replica_t *replica;
+    const sigset_t *sigmask;
+
+    // program to execute
+    const char *path;
+    char *const *argv;
+
+    int err_fd;
+    int target_fd;
+    // write end of the readiness pipe, -1 if none
+    int ready_fd;
+    // number of listeners passed
+    int listen_fd_cnt;
+    // LISTEN_PID entry of the replica environment, NULL without listeners
+    char *listen_pid_env;
+    // WATCHDOG_PID entry of the replica environment, NULL without watchdog
+    char *watchdog_pid_env;
+    // cgroup of the service, -1 if none, and whether the child has to join
+    // it itself because the backend cannot spawn it there
+    int cgroup_fd;
+    bool join_cgroup;
+} spawn_ctx_t;
+
+static const char *backend_names[] = {
+    "fork",   // SPAWN_BACKEND_FORK
+    "vfork",  // SPAWN_BACKEND_VFORK
+    "clone3", // SPAWN_BACKEND_CLONE3
+};
+
+// Backends found unusable on the running kernel
+static bool backend_unsupported[sizeof(backend_names) / sizeof(backend_names[0])];
+
+// Stack of the vfork and clone3 backend children, allocated on first use
+static void *spawn_stack = NULL;
+
+/**
+ * @brief Get the name of a spawn backend
+ *
+ * @param backend spawn backend
+ * @return const char* backend name
+ */
+const char *spawn_backend_name(enum SPAWN_BACKEND backend)
+{
+    return backend_names[backend];
+}
+
+/**
+ * @brief Get a spawn backend by name
+ *
+ * @param name backend name
+ * @return int
+ * @retval `>=0` spawn backend
+ * @retval `-1` unknown backend
+ */
+int spawn_backend_from_name(const char *name)
+{
+    for (size_t i = 0; i < sizeof(backend_names) / sizeof(backend_names[0]); i++)
+    {
+        if (strcmp(name, backend_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Set or replace an entry in an environment array
+ *
+ * @param envp environment array, large enough for one more entry
+ * @param cnt number of entries in the array
+ * @param entry entry in the form of NAME=VALUE
+ */
+static void envp_set(char **envp, size_t *cnt, char *entry)
+{
+    size_t name_len = strchr(entry, '=') - entry + 1;
+
+    for (size_t i = 0; i < *cnt; i++)
+    {
+        if (strncmp(envp[i], entry, name_len) == 0)
+        {
+            envp[i] = entry;
+            return;
+        }
+    }
+
+    envp[(*cnt)++] = entry;
+    envp[*cnt] = NULL;
+}
+
+/**
+ * @brief Open a log file for the child
+ *
+ * @param file file path
+ * @return int
+ * @retval `fd` file descriptor
+ * @retval `-1` failed
+ */
+static int open_log_file(const char *file)
+{
+    int fd = open(file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        log_error("failed to open %s: %s", file, strerror(errno));
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Open a log file of a replica
+ *
+ * Every "%i" in the path is replaced by the replica index.
+ *
+ * @param file file path
+ * @param index replica index
+ * @return int
+ * @retval `fd` file descriptor
+ * @retval `-1` failed
+ */
+static int open_replica_log_file(const char *file, int index)
+{
+    char path[PATH_MAX];
+    size_t len = 0;
+
+    for (const char *p = file; *p && len < sizeof(path) - 1; p++)
+    {
+        if (p[0] == '%' && p[1] == 'i')
+        {
+            len += snprintf(path + len, sizeof(path) - len, "%d", index);
+            p++;
+            continue;
+        }
+
+        path[len++] = *p;
+    }
+
+    if (len >= sizeof(path) - 1)
+    {
+        log_error("failed to open %s: %s", file, strerror(ENAMETOOLONG));
+        return -1;
+    }
+
+    path[len] = '\0';
+
+    return open_log_file(path);
+}
+
+/**
+ * @brief Build the part of the spawn plan specific to a replica
+ *
+ * @param plan spawn plan, its base environment must be built
+ * @param opt option
+ * @param index replica index
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int spawn_replica_init(spawn_plan_t *plan, const option_t *opt, int index)
+{
+    spawn_replica_t *replica = &plan->replicas[index];
+    size_t cnt = 0;
+
+    while (plan->envp[cnt])
+    {
+        cnt++;
+    }
+
+    // RUND_REPLICA, LISTEN_PID, WATCHDOG_PID and the terminating NULL
+    replica->envp = malloc((cnt + 3 + 1) * sizeof(char *));
+    if (!replica->envp)
+    {
+        log_error("failed to malloc: %s", strerror(errno));
+        return -1;
+    }
+
+    memcpy(replica->envp, plan->envp, (cnt + 1) * sizeof(char *));
+
+    if (plan->replica_cnt > 1)
+    {
+        if (asprintf(&replica->replica_env, "RUND_REPLICA=%d", index) < 0)
+        {
+            replica->replica_env = NULL;
+            log_error("failed to asprintf: %s", strerror(errno));
+            return -1;
+        }
+
+        envp_set(replica->envp, &cnt, replica->replica_env);
+    }
+
+    if (opt->listen_cnt > 0)
+    {
+        strcpy(replica->listen_pid_env, LISTEN_PID_PREFIX);
+        envp_set(replica->envp, &cnt, replica->listen_pid_env);
+    }
+
+    if (opt->watchdog_ms > 0)
+    {
+        strcpy(replica->watchdog_pid_env, WATCHDOG_PID_PREFIX);
+        envp_set(replica->envp, &cnt, replica->watchdog_pid_env);
+    }
+
+    if (opt->stdout_file)
+    {
+        replica->stdout_fd = open_replica_log_file(opt->stdout_file, index);
+        if (replica->stdout_fd < 0)
+        {
+            return -1;
+        }
+    }
+
+    if (opt->stderr_file)
+    {
+        replica->stderr_fd = open_replica_log_file(opt->stderr_file, index);
+        if (replica->stderr_fd < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Resolve the supplementary groups of the running user
+ *
+ * @param plan spawn plan
+ * @param opt option
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int resolve_groups(spawn_plan_t *plan, const option_t *opt)
+{
+    int group_cnt = 16;
+
+    while (1)
+    {
+        gid_t *temp = realloc(plan->groups, group_cnt * sizeof(gid_t));
+        if (!temp)
+        {
+            log_error("failed to realloc: %s", strerror(errno));
+            return -1;
+        }
+
+        plan->groups = temp;
+
+        int n = group_cnt;
+        if (getgrouplist(opt->user, opt->gid, plan->groups, &n) >= 0)
+        {
+            plan->group_cnt = n;
+            return 0;
+        }
+
+        // buffer too small, n holds the required size
+        group_cnt = n > group_cnt ? n : group_cnt * 2;
+    }
+}
+
+/**
+ * @brief Prepare the listeners of the target, opened by spawn_plan_open()
+ *
+ * @param plan spawn plan
+ * @param opt option
+ * @param cnt number of entries in the base environment, updated
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int init_listeners(spawn_plan_t *plan, const option_t *opt, size_t *cnt)
+{
+    plan->listen_fds = malloc(opt->listen_cnt * sizeof(int));
+    if (!plan->listen_fds)
+    {
+        log_error("failed to malloc: %s", strerror(errno));
+        return -1;
+    }
+
+    if (asprintf(&plan->listen_fds_env, "LISTEN_FDS=%zu", opt->listen_cnt) < 0)
+    {
+        plan->listen_fds_env = NULL;
+        log_error("failed to asprintf: %s", strerror(errno));
+        return -1;
+    }
+
+    envp_set(plan->envp, cnt, plan->listen_fds_env);
+
+    return 0;
+}
+
+/**
+ * @brief Build the spawn plan of the target
+ *
+ * Resolves everything the child needs once, so that respawning does not
+ * depend on directory services and the child only makes a few non-allocating
+ * syscalls between fork and exec: the complete environment for execve(), the
+ * supplementary groups for setgroups() and the opened log files. Listeners
+ * and the cgroup are set up later by spawn_plan_open().
+ *
+ * @param plan spawn plan
+ * @param opt option
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int spawn_plan_init(spawn_plan_t *plan, const option_t *opt)
+{
+    size_t cnt = 0;
+
+    while (environ[cnt])
+    {
+        cnt++;
+    }
+
+    // LISTEN_FDS, NOTIFY_SOCKET, WATCHDOG_USEC and the terminating NULL
+    plan->envp = malloc((cnt + opt->environment_cnt + SPAWN_PLAN_USER_ENV_CNT + 3 + 1) * sizeof(char *));
+    if (!plan->envp)
+    {
+        log_error("failed to malloc: %s", strerror(errno));
+        return -1;
+    }
+
+    memcpy(plan->envp, environ, (cnt + 1) * sizeof(char *));
+
+    for (size_t i = 0; i < opt->environment_cnt; i++)
+    {
+        envp_set(plan->envp, &cnt, opt->environments[i]);
+    }
+
+    if (opt->user)
+    {
+        if (asprintf(&plan->user_env[0], "USER=%s", opt->user) < 0 ||
+            asprintf(&plan->user_env[1], "LOGNAME=%s", opt->user) < 0 ||
+            asprintf(&plan->user_env[2], "HOME=%s", opt->home_dir) < 0)
+        {
+            log_error("failed to asprintf: %s", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < SPAWN_PLAN_USER_ENV_CNT; i++)
+        {
+            envp_set(plan->envp, &cnt, plan->user_env[i]);
+        }
+
+        if (resolve_groups(plan, opt) < 0)
+        {
+            return -1;
+        }
+    }
+
+    if (opt->listen_cnt > 0 && init_listeners(plan, opt, &cnt) < 0)
+    {
+        return -1;
+    }
+
+    // keep-alives are sent to the notify socket as well
+    if (opt->notify || opt->watchdog_ms > 0)
+    {
+        // shared by all services, owned by the notify socket
+        char *notify_env = notify_socket_env();
+        if (!notify_env)
+        {
+            return -1;
+        }
+
+        envp_set(plan->envp, &cnt, notify_env);
+    }
+
+    if (opt->watchdog_ms > 0)
+    {
+        if (asprintf(&plan->watchdog_usec_env, "WATCHDOG_USEC=%llu", (unsigned long long)opt->watchdog_ms * 1000) < 0)
+        {
+            plan->watchdog_usec_env = NULL;
+            log_error("failed to asprintf: %s", strerror(errno));
+            return -1;
+        }
+
+        envp_set(plan->envp, &cnt, plan->watchdog_usec_env);
+    }
+
+    plan->replicas = calloc(opt->replica_cnt, sizeof(spawn_replica_t));
+    if (!plan->replicas)
+    {
+        log_error("failed to calloc: %s", strerror(errno));
+        return -1;
+    }
+
+    for (int i = 0; i < opt->replica_cnt; i++)
+    {
+        plan->replicas[i].stdout_fd = -1;
+        plan->replicas[i].stderr_fd = -1;
+        plan->replicas[i].cgroup_fds[0] = -1;
+        plan->replicas[i].cgroup_fds[1] = -1;
+        plan->replicas[i].numa_node = NUMA_NODE_NONE;
+        plan->replicas[i].core = -1;
+    }
+
+    plan->replica_cnt = opt->replica_cnt;
+
+    if (affinity_plan_init(plan, opt) < 0)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < opt->replica_cnt; i++)
+    {
+        if (spawn_replica_init(plan, opt, i) < 0)
+        {
+            return -1;
+        }
+    }
+
+    if (!opt->exec_by_path)
+    {
+        // pin the inode, so respawns neither resolve the path again nor race a rename
+        plan->target_fd = open(opt->target, O_PATH | O_CLOEXEC);
+        if (plan->target_fd < 0)
+        {
+            log_error("failed to open %s: %s", opt->target, strerror(errno));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Open what the spawn plan shares with the outside world
+ *
+ * Listeners and the cgroup are only set up once rund holds the lock of its
+ * pid file, so that a second rund, about to fail the lock, never takes over
+ * the sockets of the running one nor rewrites the limits of its cgroup.
+ *
+ * @param plan spawn plan, built by spawn_plan_init()
+ * @param opt option the plan was built from
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int spawn_plan_open(spawn_plan_t *plan, const option_t *opt)
+{
+    for (size_t i = 0; i < opt->listen_cnt; i++)
+    {
+        int fd = listen_open(opt->listens[i]);
+        if (fd < 0)
+        {
+            return -1;
+        }
+
+        plan->listen_fds[plan->listen_fd_cnt++] = fd;
+    }
+
+    if (opt->cgroup_root && cgroup_create(plan, opt) < 0)
+    {
+        return -1;
+    }
+
+    for (int i = 0; opt->kill_mode == KILL_MODE_CGROUP && i < plan->replica_cnt; i++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            plan->replicas[i].cgroup_fds[k] = cgroup_leaf_open(plan, i, k);
+            if (plan->replicas[i].cgroup_fds[k] < 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Free the spawn plan
+ *
+ * @param plan spawn plan
+ * @param opt option the plan was built from
+ */
+void spawn_plan_free(spawn_plan_t *plan, const option_t *opt)
+{
+    for (int i = 0; i < SPAWN_PLAN_USER_ENV_CNT; i++)
+    {
+        free(plan->user_env[i]);
+        plan->user_env[i] = NULL;
+    }
+
+    free(plan->envp);
+    plan->envp = NULL;
+
+    free(plan->groups);
+    plan->groups = NULL;
+    plan->group_cnt = 0;
+
+    for (int i = 0; i < plan->replica_cnt; i++)
+    {
+        spawn_replica_t *replica = &plan->replicas[i];
+
+        free(replica->envp);
+        free(replica->replica_env);
+
+        if (replica->stdout_fd >= 0)
+        {
+            close(replica->stdout_fd);
+        }
+
+        if (replica->stderr_fd >= 0)
+        {
+            close(replica->stderr_fd);
+        }
+
+        for (int k = 0; k < 2; k++)
+        {
+            cgroup_leaf_close(plan, i, k, replica->cgroup_fds[k]);
+        }
+    }
+
+    free(plan->replicas);
+    plan->replicas = NULL;
+    plan->replica_cnt = 0;
+
+    for (int i = 0; i < plan->listen_fd_cnt; i++)
+    {
+        listen_close(opt->listens[i], plan->listen_fds[i]);
+    }
+
+    free(plan->listen_fds);
+    plan->listen_fds = NULL;
+    plan->listen_fd_cnt = 0;
+
+    free(plan->listen_fds_env);
+    plan->listen_fds_env = NULL;
+
+    free(plan->watchdog_usec_env);
+    plan->watchdog_usec_env = NULL;
+
+    if (plan->target_fd >= 0)
+    {
+        close(plan->target_fd);
+        plan->target_fd = -1;
+    }
+
+    cgroup_remove(plan);
+}
+
+/**
+ * @brief Report a failed setup step to the parent
+ *
+ * @param ctx spawn context
+ * @param step failed step
+ * @param err errno of the failure
+ */
+static void child_report(const spawn_ctx_t *ctx, enum SPAWN_STEP step, int err)
+{
+    spawn_report_t report = {
+        .step = step,
+        .err = err,
+    };
+
+    write(ctx->err_fd, &report, sizeof(report));
+}
+
+/**
+ * @brief Redirect stdout or stderr to an opened log file in the child
+ *
+ * @param fd log file descriptor, -1 to keep the current one
+ * @param target_fd STDOUT_FILENO or STDERR_FILENO
+ */
+static void child_redirect(int fd, int target_fd)
+{
+    if (fd < 0)
+    {
+        return;
+    }
+
+    if (fd == target_fd)
+    {
+        // dup2() would be a no-op and leave the close-on-exec flag set
+        fcntl(fd, F_SETFD, 0);
+        return;
+    }
+
+    dup2(fd, target_fd);
+}
+
+/**
+ * @brief Move a descriptor out of the range of the passed descriptors
+ *
+ * @param fd descriptor, -1 if none
+ * @param top first descriptor number above the passed ones
+ * @return int the descriptor to use from now on
+ */
+static int child_move_fd(int fd, int top)
+{
+    if (fd < LISTEN_FDS_START || fd >= top)
+    {
+        return fd;
+    }
+
+    return fcntl(fd, F_DUPFD_CLOEXEC, top);
+}
+
+/**
+ * @brief Move the descriptors passed to the target to their numbers in the child
+ *
+ * Listeners go from `LISTEN_FDS_START` on and the readiness pipe to
+ * `opt->ready_fd`. Every descriptor in the way is moved out first, so none is
+ * overwritten before it has been passed or used.
+ *
+ * @param ctx spawn context, private to the child
+ */
+static void child_pass_fds(spawn_ctx_t *ctx)
+{
+    const spawn_plan_t *plan = ctx->plan;
+    int listen_fds[LISTEN_FDS_MAX];
+    int top = LISTEN_FDS_START + ctx->listen_fd_cnt;
+
+    if (ctx->ready_fd >= 0 && ctx->opt->ready_fd >= top)
+    {
+        top = ctx->opt->ready_fd + 1;
+    }
+
+    if (top == LISTEN_FDS_START)
+    {
+        return;
+    }
+
+    for (int i = 0; i < ctx->listen_fd_cnt; i++)
+    {
+        listen_fds[i] = child_move_fd(plan->listen_fds[i], top);
+    }
+
+    int ready_fd = child_move_fd(ctx->ready_fd, top);
+    ctx->target_fd = child_move_fd(ctx->target_fd, top);
+    ctx->err_fd = child_move_fd(ctx->err_fd, top);
+
+    // dup2() clears the close-on-exec flag of the copy
+    for (int i = 0; i < ctx->listen_fd_cnt; i++)
+    {
+        dup2(listen_fds[i], LISTEN_FDS_START + i);
+    }
+
+    if (ready_fd >= 0)
+    {
+        dup2(ready_fd, ctx->opt->ready_fd);
+    }
+}
+
+/**
+ * @brief Write the pid of the child to an entry of its environment
+ *
+ * The entry is only read by execve(): with the vfork backend the parent is
+ * suspended until then, with the others the memory is a private copy.
+ *
+ * @param entry entry in the form of NAME=, large enough for the pid
+ */
+static void child_set_pid_env(char *entry)
+{
+    char digits[16];
+    int n = 0;
+    pid_t pid = getpid();
+    char *p = strchr(entry, '=') + 1;
+
+    do
+    {
+        digits[n++] = '0' + pid % 10;
+        pid /= 10;
+    } while (pid > 0);
+
+    while (n > 0)
+    {
+        *p++ = digits[--n];
+    }
+
+    *p = '\0';
+}
+
+/**
+ * @brief Move the child into the cgroup of the service
+ *
+ * Only for the fork backend, and for the vfork backend on kernels without
+ * CLONE_INTO_CGROUP.
+ *
+ * @param ctx spawn context
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int child_join_cgroup(const spawn_ctx_t *ctx)
+{
+    int fd = openat(ctx->cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || write(fd, "0", 1) < 0)
+    {
+        child_report(ctx, SPAWN_STEP_CGROUP, errno);
+        return -1;
+    }
+
+    close(fd);
+
+    return 0;
+}
+
+/**
+ * @brief Pin the child to the CPUs of its replica, and bind its memory to the
+ * NUMA node of the replica
+ *
+ * Both are inherited across execve() and by the processes the target forks.
+ *
+ * @param ctx spawn context
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int child_set_affinity(const spawn_ctx_t *ctx)
+{
+    const spawn_replica_t *replica = ctx->replica;
+
+    if (replica->pin_cpus && sched_setaffinity(0, sizeof(replica->cpus), (const cpu_set_t *)&replica->cpus) < 0)
+    {
+        child_report(ctx, SPAWN_STEP_AFFINITY, errno);
+        return -1;
+    }
+
+    if (replica->numa_node >= 0)
+    {
+        cpu_mask_t nodes = {{0}};
+
+        cpu_mask_set(&nodes, replica->numa_node);
+
+        // maxnode counts one past the highest bit the kernel reads
+        if (syscall(SYS_set_mempolicy, MPOL_BIND, nodes.bits, CPU_MASK_BITS + 1) < 0)
+        {
+            child_report(ctx, SPAWN_STEP_MEMPOLICY, errno);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Set the resource limits of the child
+ *
+ * Done before switching user, raising a hard limit takes privileges the
+ * user may not have.
+ *
+ * @param ctx spawn context
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int child_set_rlimits(const spawn_ctx_t *ctx)
+{
+    const option_t *opt = ctx->opt;
+
+    for (int i = 0; i < opt->rlimit_cnt; i++)
+    {
+        const rlimit_spec_t *spec = &opt->rlimits[i];
+        struct rlimit limit = {
+            .rlim_cur = spec->soft == RLIMIT_UNLIMITED ? RLIM_INFINITY : (rlim_t)spec->soft,
+            .rlim_max = spec->hard == RLIMIT_UNLIMITED ? RLIM_INFINITY : (rlim_t)spec->hard,
+        };
+
+        if (setrlimit(spec->resource, &limit) < 0)
+        {
+            child_report(ctx, SPAWN_STEP_RLIMIT, errno);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write the OOM score adjustment of the child
+ *
+ * Formats the value by hand, the child may share memory with the parent.
+ *
+ * @param value adjustment, -1000 to 1000
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int child_write_oom_score_adj(int value)
+{
+    char buf[8];
+    char *p = buf + sizeof(buf);
+    unsigned int magnitude = value < 0 ? -value : value;
+
+    do
+    {
+        *--p = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (value < 0)
+    {
+        *--p = '-';
+    }
+
+    int fd = open("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (write(fd, p, buf + sizeof(buf) - p) < 0)
+    {
+        // reported by the caller
+        int err = errno;
+
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    close(fd);
+
+    return 0;
+}
+
+/**
+ * @brief Set the scheduling policy, nice value, IO priority and OOM score
+ * adjustment of the child
+ *
+ * Done before switching user, raising them takes privileges the user may
+ * not have.
+ *
+ * @param ctx spawn context
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int child_set_priority(const spawn_ctx_t *ctx)
+{
+    const option_t *opt = ctx->opt;
+    struct sched_param param = {.sched_priority = opt->sched_priority};
+    int policy = -1;
+
+    switch (opt->sched_class)
+    {
+    case SCHED_CLASS_FIFO:
+        policy = SCHED_FIFO;
+        break;
+
+    case SCHED_CLASS_RR:
+        policy = SCHED_RR;
+        break;
+
+    case SCHED_CLASS_BATCH:
+        policy = SCHED_BATCH;
+        break;
+
+    case SCHED_CLASS_IDLE:
+        policy = SCHED_IDLE;
+        break;
+
+    default:
+        break;
+    }
+
+    if (policy >= 0 && sched_setscheduler(0, policy, &param) < 0)
+    {
+        child_report(ctx, SPAWN_STEP_SCHED, errno);
+        return -1;
+    }
+
+    if (opt->nice != PRIORITY_UNSET && setpriority(PRIO_PROCESS, 0, opt->nice) < 0)
+    {
+        child_report(ctx, SPAWN_STEP_NICE, errno);
+        return -1;
+    }
+
+    if (opt->io_class != IO_CLASS_NONE &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, opt->io_class << IOPRIO_CLASS_SHIFT | opt->io_priority) < 0)
+    {
+        child_report(ctx, SPAWN_STEP_IOPRIO, errno);
+        return -1;
+    }
+
+    if (opt->oom_score_adj != PRIORITY_UNSET && child_write_oom_score_adj(opt->oom_score_adj) < 0)
+    {
+        child_report(ctx, SPAWN_STEP_OOM_SCORE_ADJ, errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Set user and group in the child
+ *
+ * @param ctx spawn context
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int set_user_and_group(const spawn_ctx_t *ctx)
+{
+    const option_t *opt = ctx->opt;
+
+    if (!opt->user)
+    {
+        return 0;
+    }
+
+    if (setgroups(ctx->plan->group_cnt, ctx->plan->groups) < 0)
+    {
+        child_report(ctx, SPAWN_STEP_GROUPS, errno);
+        return -1;
+    }
+
+    if (setgid(opt->gid) < 0)
+    {
+        child_report(ctx, SPAWN_STEP_GID, errno);
+        return -1;
+    }
+
+    if (setuid(opt->uid) < 0)
+    {
+        child_report(ctx, SPAWN_STEP_UID, errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Set up the child and execute the target
+ *
+ * Runs between clone/fork and execve(). It may share memory with the parent,
+ * so it only makes syscalls on data prepared by the parent and never returns.
+ *
+ * @param arg spawn context
+ * @return int never returns
+ */
+static int child_main(void *arg)
+{
+    // private copy, the descriptors may be moved around
+    spawn_ctx_t child_ctx = *(const spawn_ctx_t *)arg;
+    spawn_ctx_t *ctx = &child_ctx;
+    const option_t *opt = ctx->opt;
+
+    sigprocmask(SIG_SETMASK, ctx->sigmask, NULL);
+
+    if (ctx->join_cgroup && child_join_cgroup(ctx) < 0)
+    {
+        _exit(CHILD_EXEC_ERR_CODE);
+    }
+
+    if (child_set_affinity(ctx) < 0)
+    {
+        _exit(CHILD_EXEC_ERR_CODE);
+    }
+
+    setsid();
+    umask(022);
+
+    if (opt->working_dir)
+    {
+        chdir(opt->working_dir);
+    }
+
+    child_redirect(ctx->replica->stdout_fd, STDOUT_FILENO);
+    child_redirect(ctx->replica->stderr_fd, STDERR_FILENO);
+    child_pass_fds(ctx);
+
+    if (ctx->listen_pid_env)
+    {
+        child_set_pid_env(ctx->listen_pid_env);
+    }
+
+    if (ctx->watchdog_pid_env)
+    {
+        child_set_pid_env(ctx->watchdog_pid_env);
+    }
+
+    if (child_set_rlimits(ctx) < 0 || child_set_priority(ctx) < 0)
+    {
+        _exit(CHILD_EXEC_ERR_CODE);
+    }
+
+    // switch user
+    if (set_user_and_group(ctx) < 0)
+    {
+        _exit(CHILD_EXEC_ERR_CODE);
+    }
+
+    if (ctx->target_fd >= 0)
+    {
+        syscall(SYS_execveat, ctx->target_fd, "", ctx->argv, ctx->replica->envp, AT_EMPTY_PATH);
+
+        // ENOENT: a script, its interpreter cannot open the close-on-exec descriptor
+        // ENOSYS: kernel without execveat()
+        if (errno != ENOENT && errno != ENOSYS)
+        {
+            child_report(ctx, SPAWN_STEP_EXEC, errno);
+            _exit(CHILD_EXEC_ERR_CODE);
+        }
+    }
+
+    execve(ctx->path, ctx->argv, ctx->replica->envp);
+
+    child_report(ctx, SPAWN_STEP_EXEC, errno);
+    _exit(CHILD_EXEC_ERR_CODE);
+}
+
+/**
+ * @brief Check whether a spawn error means the kernel lacks the backend
+ *
+ * @param err errno of the failed spawn
+ * @return bool
+ */
+static bool backend_errno_unsupported(int err)
+{
+    // E2BIG: kernel with clone3() but without CLONE_INTO_CGROUP
+    return err == ENOSYS || err == EINVAL || err == E2BIG;
+}
+
+/**
+ * @brief Allocate the stack of the child on first use
+ *
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int spawn_stack_init(void)
+{
+    if (spawn_stack)
+    {
+        return 0;
+    }
+
+    spawn_stack = mmap(NULL, SPAWN_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (spawn_stack == MAP_FAILED)
+    {
+        spawn_stack = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Spawn the child with fork()
+ *
+ * @param ctx spawn context
+ * @param pidfd buffer to store the pidfd, always -1 for this backend
+ * @return pid_t
+ * @retval `>0` process ID of the child
+ * @retval `-1` failed
+ */
+static pid_t spawn_fork(spawn_ctx_t *ctx, int *pidfd)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        child_main(ctx);
+    }
+
+    *pidfd = -1;
+
+    return pid;
+}
+
+/**
+ * @brief Call clone3() and run child_main() in the child
+ *
+ * The child starts on the stack given in @p args, where the frames of the
+ * syscall() wrapper do not exist, so it calls child_main() right after the
+ * syscall instruction and never returns here.
+ *
+ * @param args clone3() arguments, with a stack
+ * @param size size of @p args
+ * @param ctx spawn context passed to child_main()
+ * @return pid_t
+ * @retval `>0` process ID of the child
+ * @retval `-1` failed, ENOSYS on architectures without a trampoline
+ */
+static pid_t clone3_trampoline(struct spawn_clone_args *args, size_t size, spawn_ctx_t *ctx)
+{
+    long ret;
+
+#if defined(__x86_64__)
+    register long rax __asm__("rax") = SYS_clone3;
+    register long rdi __asm__("rdi") = (long)args;
+    register long rsi __asm__("rsi") = (long)size;
+    register long r12 __asm__("r12") = (long)ctx;
+    register long r13 __asm__("r13") = (long)child_main;
+
+    // the child inherits r12 and r13, and gets a 16 byte aligned stack
+    __asm__ volatile("syscall\n\t"
+                     "test %%rax, %%rax\n\t"
+                     "jnz 1f\n\t"
+                     "xor %%ebp, %%ebp\n\t"
+                     "mov %%r12, %%rdi\n\t"
+                     "call *%%r13\n\t"
+                     "ud2\n"
+                     "1:"
+                     : "+r"(rax)
+                     : "r"(rdi), "r"(rsi), "r"(r12), "r"(r13)
+                     : "rcx", "r11", "memory");
+    ret = rax;
+#elif defined(__aarch64__)
+    register long x8 __asm__("x8") = SYS_clone3;
+    register long x0 __asm__("x0") = (long)args;
+    register long x1 __asm__("x1") = (long)size;
+    register long x19 __asm__("x19") = (long)ctx;
+    register long x20 __asm__("x20") = (long)child_main;
+
+    __asm__ volatile("svc #0\n\t"
+                     "cbnz x0, 1f\n\t"
+                     "mov x29, xzr\n\t"
+                     "mov x30, xzr\n\t"
+                     "mov x0, x19\n\t"
+                     "blr x20\n\t"
+                     "brk #0\n"
+                     "1:"
+                     : "+r"(x0)
+                     : "r"(x8), "r"(x1), "r"(x19), "r"(x20)
+                     : "memory");
+    ret = x0;
+#else
+    (void)args;
+    (void)size;
+    (void)ctx;
+    ret = -ENOSYS;
+#endif
+
+    if (ret < 0)
+    {
+        errno = -ret;
+        return -1;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Spawn the child with clone3(CLONE_VM | CLONE_VFORK | CLONE_PIDFD)
+ *
+ * Shares the address space of the parent like the vfork backend, and also
+ * starts the child in the cgroup of the service with CLONE_INTO_CGROUP
+ * instead of migrating it there.
+ *
+ * @param ctx spawn context
+ * @param pidfd buffer to store the pidfd
+ * @return pid_t
+ * @retval `>0` process ID of the child
+ * @retval `-1` failed
+ */
+static pid_t spawn_clone3(spawn_ctx_t *ctx, int *pidfd)
+{
+    if (spawn_stack_init() < 0)
+    {
+        return -1;
+    }
+
+    struct spawn_clone_args args = {
+        .flags = CLONE_VM | CLONE_VFORK | CLONE_PIDFD,
+        .pidfd = (uint64_t)(uintptr_t)pidfd,
+        .exit_signal = SIGCHLD,
+        .stack = (uint64_t)(uintptr_t)spawn_stack,
+        .stack_size = SPAWN_STACK_SIZE,
+    };
+    size_t size = SPAWN_CLONE_ARGS_SIZE_VER0;
+
+    if (ctx->cgroup_fd >= 0)
+    {
+        args.flags |= CLONE_INTO_CGROUP;
+        args.cgroup = ctx->cgroup_fd;
+        size = sizeof(args);
+    }
+
+    return clone3_trampoline(&args, size, ctx);
+}
+
+/**
+ * @brief Spawn the child with clone(CLONE_VM | CLONE_VFORK | CLONE_PIDFD)
+ *
+ * The child runs on its own stack in the address space of the parent, so no
+ * page tables are copied no matter how large the supervisor grows. The parent
+ * is suspended until the child calls execve() or exits.
+ *
+ * With a cgroup, the child is spawned by clone3() straight into it, with the
+ * same semantics. clone() only remains for kernels without CLONE_INTO_CGROUP,
+ * where the child moves itself into the cgroup.
+ *
+ * @param ctx spawn context
+ * @param pidfd buffer to store the pidfd
+ * @return pid_t
+ * @retval `>0` process ID of the child
+ * @retval `-1` failed
+ */
+static pid_t spawn_vfork(spawn_ctx_t *ctx, int *pidfd)
+{
+    if (ctx->cgroup_fd >= 0 && !backend_unsupported[SPAWN_BACKEND_CLONE3])
+    {
+        pid_t pid = spawn_clone3(ctx, pidfd);
+        if (pid >= 0 || !backend_errno_unsupported(errno))
+        {
+            return pid;
+        }
+
+        log_warn("clone3 cannot spawn into the cgroup, children will migrate there");
+        backend_unsupported[SPAWN_BACKEND_CLONE3] = true;
+    }
+
+    if (spawn_stack_init() < 0)
+    {
+        return -1;
+    }
+
+    ctx->join_cgroup = ctx->cgroup_fd >= 0;
+
+    // the stack grows down on all architectures supported by Linux but hppa
+    return clone(child_main,
+                 (char *)spawn_stack + SPAWN_STACK_SIZE,
+                 CLONE_VM | CLONE_VFORK | CLONE_PIDFD | SIGCHLD,
+                 ctx,
+                 pidfd);
+}
+
+/**
+ * @brief Log the failures reported by the child
+ *
+ * @param path program executed by the child
+ * @param fd read end of the error pipe
+ * @return bool
+ * @retval `true` the child failed before executing the program
+ * @retval `false` the program is executed
+ */
+static bool read_child_reports(const char *path, int fd)
+{
+    spawn_report_t report;
+    bool failed = false;
+
+    while (read(fd, &report, sizeof(report)) == sizeof(report))
+    {
+        failed = true;
+
+
+        switch (report.step)
+        {
+        case SPAWN_STEP_CGROUP:
+            log_error("failed to join cgroup: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_AFFINITY:
+            log_error("failed to set CPU affinity: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_MEMPOLICY:
+            log_error("failed to bind memory to NUMA node: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_SCHED:
+            log_error("failed to set scheduling policy: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_NICE:
+            log_error("failed to set nice value: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_IOPRIO:
+            log_error("failed to set IO priority: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_OOM_SCORE_ADJ:
+            log_error("failed to set OOM score adjustment: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_RLIMIT:
+            log_error("failed to set resource limit: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_GROUPS:
+            log_error("failed to init groups: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_GID:
+            log_error("failed to switch group: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_UID:
+            log_error("failed to switch user: %s", strerror(report.err));
+            break;
+
+        case SPAWN_STEP_EXEC:
+            log_error("failed to execute %s: %s", path, strerror(report.err));
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return failed;
+}
+
+/**
+ * @brief Spawn a child with the backend selected by the option
+ *
+ * Falls back to fork() when the running kernel does not support the
+ * backend. Setup and exec failures in the child are logged here, and the
+ * child, which exits with `CHILD_EXEC_ERR_CODE`, is reaped at once.
+ *
+ * @param ctx spawn context, without the error pipe
+ * @param pidfd buffer to store the pidfd of the child, -1 if not available
+ * @return pid_t
+ * @retval `>0` process ID of the child, running the program
+ * @retval `-1` failed
+ */
+static pid_t spawn_child(spawn_ctx_t *ctx, int *pidfd)
+{
+    int pipefd[2];
+    pid_t pid = -1;
+    enum SPAWN_BACKEND backend = ctx->opt->spawn_backend;
+
+    if (pipe2(pipefd, O_CLOEXEC) < 0)
+    {
+        log_error("failed to create pipe: %s", strerror(errno));
+        return -1;
+    }
+
+    ctx->err_fd = pipefd[1];
+    *pidfd = -1;
+
+    while (pid < 0)
+    {
+        if (backend_unsupported[backend])
+        {
+            backend = SPAWN_BACKEND_FORK;
+        }
+
+        // the vfork backend sets it when it falls back to clone()
+        ctx->join_cgroup = ctx->cgroup_fd >= 0 && backend == SPAWN_BACKEND_FORK;
+
+        switch (backend)
+        {
+        case SPAWN_BACKEND_VFORK:
+            pid = spawn_vfork(ctx, pidfd);
+            break;
+
+        case SPAWN_BACKEND_CLONE3:
+            pid = spawn_clone3(ctx, pidfd);
+            break;
+
+        default:
+            pid = spawn_fork(ctx, pidfd);
+            break;
+        }
+
+        if (pid >= 0 || backend == SPAWN_BACKEND_FORK || !backend_errno_unsupported(errno))
+        {
+            break;
+        }
+
+        log_warn("spawn backend %s is not supported, falling back to fork", backend_names[backend]);
+        backend_unsupported[backend] = true;
+    }
+
+    close(pipefd[1]);
+
+    if (pid < 0)
+    {
+        log_error("failed to spawn %s: %s", ctx->path, strerror(errno));
+    }
+    // returns once the child has called execve() or exited
+    else if (read_child_reports(ctx->path, pipefd[0]))
+    {
+        waitpid(pid, NULL, 0);
+
+        if (*pidfd >= 0)
+        {
+            close(*pidfd);
+            *pidfd = -1;
+        }
+
+        pid = -1;
+    }
+
+    close(pipefd[0]);
+
+    return pid;
+}
+
+/**
+ * @brief Spawn the target process
+ *
+ * @param opt option
+ * @param replica index of the replica to spawn
+ * @param slot process slot of the instance, selects the cgroup of the child
+ *             when the kill mode is cgroup
+ * @param sigmask signal mask to restore in the child
+ * @param ready_fd write end of the readiness pipe, passed to the child as
+ *                 `opt->ready_fd`, -1 if none
+ * @param pidfd buffer to store the pidfd of the child, -1 if not available
+ * @return pid_t
+ * @retval `>0` process ID of the child
+ * @retval `-1` failed
+ */
+pid_t spawn_process(const option_t *opt, int replica, int slot, const sigset_t *sigmask, int ready_fd, int *pidfd)
+{
+    int cgroup_fd = opt->plan.replicas[replica].cgroup_fds[slot];
+
+    spawn_ctx_t ctx = {
+        .opt = opt,
+        .plan = &opt->plan,
+        .replica = &opt->plan.replicas[replica],
+        .sigmask = sigmask,
+        .path = opt->target,
+        .argv = opt->target_argv,
+        .target_fd = opt->plan.target_fd,
+        .ready_fd = ready_fd,
+        .listen_fd_cnt = opt->plan.listen_fd_cnt,
+        .listen_pid_env = opt->plan.listen_fd_cnt > 0 ? opt->plan.replicas[replica].listen_pid_env : NULL,
+        .watchdog_pid_env = opt->watchdog_ms > 0 ? opt->plan.replicas[replica].watchdog_pid_env : NULL,
+        .cgroup_fd = cgroup_fd >= 0 ? cgroup_fd : opt->plan.cgroup_fd,
+    };
+
+    return spawn_child(&ctx, pidfd);
+}
+
+/**
+ * @brief Spawn a command in the context of the target
+ *
+ * The command runs like a replica of the target: same user, cgroup, working
+ * directory, environment and log files, but gets neither the listeners nor
+ * the readiness pipe.
+ *
+ * @param opt option
+ * @param replica index of the replica the command is run for
+ * @param sigmask signal mask to restore in the child
+ * @param argv command, argv[0] is the path of the program
+ * @param pidfd buffer to store the pidfd of the child, -1 if not available
+ * @return pid_t
+ * @retval `>0` process ID of the child
+ * @retval `-1` failed
+ */
+pid_t spawn_command(const option_t *opt, int replica, const sigset_t *sigmask, char *const *argv, int *pidfd)
+{
+    spawn_ctx_t ctx = {
+        .opt = opt,
+        .plan = &opt->plan,
+        .replica = &opt->plan.replicas[replica],
+        .sigmask = sigmask,
+        .path = argv[0],
+        .argv = argv,
+        .target_fd = -1,
+        .ready_fd = -1,
+        .cgroup_fd = opt->plan.cgroup_fd,
+    };
+
+    return spawn_child(&ctx, pidfd);
+}
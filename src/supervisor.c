@@ -0,0 +1,2275 @@
+// SPDX-License-Identifier: GPL-3.0
+/**
+ * @file supervisor.c
+ * @brief brief
+ * @details details
+ * @author Frank <uuidxx@163.com>
+ *
+ * @section Changelog
+ * Date         Author                          Notes
+ * 2026-10-15   Frank <uuidxx@163.com>          the first version
+ * 2026-10-15   Frank <uuidxx@163.com>          name instances after their service
+ * 2026-10-15   Frank <uuidxx@163.com>          add respawn backoff with jitter
+ * 2026-10-15   Frank <uuidxx@163.com>          add respawn rate limit with circuit breaker
+ * 2026-10-15   Frank <uuidxx@163.com>          add zero-downtime restart
+ * 2026-10-15   Frank <uuidxx@163.com>          handle sd_notify messages
+ * 2026-10-15   Frank <uuidxx@163.com>          add watchdog
+ * 2026-10-15   Frank <uuidxx@163.com>          add health probes
+ * 2026-10-15   Frank <uuidxx@163.com>          add probe latency histograms and --restart-on-p99
+ * 2026-10-15   Frank <uuidxx@163.com>          add RSS and CPU usage watchdog
+ * 2026-10-15   Frank <uuidxx@163.com>          add RSS trend recycling
+ * 2026-10-15   Frank <uuidxx@163.com>          add kill modes
+ * 2026-10-15   Frank <uuidxx@163.com>          count orphans reaped as subreaper
+ * 2026-10-16   Frank <uuidxx@163.com>          show CPU affinity in status
+ * 2026-10-16   Frank <uuidxx@163.com>          add CPU load rebalancing
+ * 2026-10-16   Frank <uuidxx@163.com>          open the spawn plan of a service when it is added
+ * 2026-10-16   Frank <uuidxx@163.com>          stop only the service whose target fails to spawn
+ * 2026-10-16   Frank <uuidxx@163.com>          cap only the exponential respawn delay
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+// supervised services
+static service_t **services = NULL;
+static size_t service_cnt = 0;
+
+// signal mask restored in spawned children
+static sigset_t child_sigmask;
+
+// number of instances not stopped for good
+static size_t live_cnt = 0;
+
+// number of running processes, including replacements and previous ones
+static size_t running_cnt = 0;
+
+static bool shutting_down = false;
+static int exit_code = EXIT_SUCCESS;
+
+// CPU load rebalancing of the instances spread by --cpus=auto, disabled
+// while rebalance_ms is 0
+static event_timer_t rebalance_timer;
+static uint64_t rebalance_ms = 0;
+static int rebalance_moves = 0;
+static uint64_t rebalance_last_ms = 0;
+
+static void graceful_shutdown(instance_t *inst);
+static int instance_restart(instance_t *inst);
+static void service_shutdown(service_t *svc);
+
+/**
+ * @brief Check if the target process should be respawned based on exit code
+ *
+ * @param opt option
+ * @param code exit code of the terminated target process
+ * @return bool
+ * @retval `true` target should be respawned
+ * @retval `false` target should not be respawned
+ */
+static bool check_respawn_required(const option_t *opt, int code)
+{
+    if (!opt->respawn)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < RESPAWN_CODE_BITS_ARRAY_SIZE; i++)
+    {
+        if (code < RESPAWN_CODE_BITS_ELEM_WIDTH)
+        {
+            return opt->respawn_code_bits[i] & (1 << code);
+        }
+
+        code -= RESPAWN_CODE_BITS_ELEM_WIDTH;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Compute the delay before respawning the target of an instance
+ *
+ * With exponential backoff, the delay doubles after each respawn up to the
+ * maximum. The jitter then shortens it by a random amount, so that services
+ * failing together do not respawn in lockstep.
+ *
+ * @param inst instance
+ * @return uint64_t delay in milliseconds
+ */
+static uint64_t respawn_delay_ms(instance_t *inst)
+{
+    const option_t *opt = inst->svc->opt;
+    uint64_t delay = opt->respawn_delay_ms;
+
+    if (opt->respawn_backoff == RESPAWN_BACKOFF_EXP && delay > 0)
+    {
+        for (unsigned int i = 0; i < inst->backoff_level && delay < opt->respawn_max_delay_ms; i++)
+        {
+            delay *= 2;
+        }
+
+        // stop counting once the maximum is reached
+        if (delay < opt->respawn_max_delay_ms)
+        {
+            inst->backoff_level++;
+        }
+
+        // the fixed delay is used as given
+        if (delay > opt->respawn_max_delay_ms)
+        {
+            delay = opt->respawn_max_delay_ms;
+        }
+    }
+
+    if (opt->respawn_jitter > 0 && delay > 0)
+    {
+        delay -= (uint64_t)random() % (delay * opt->respawn_jitter / 100 + 1);
+    }
+
+    return delay;
+}
+
+/**
+ * @brief Get the pause after the respawn limit is hit
+ *
+ * @param opt option
+ * @return uint64_t cooldown in milliseconds
+ */
+static uint64_t respawn_cooldown_ms(const option_t *opt)
+{
+    return opt->respawn_cooldown_ms ? opt->respawn_cooldown_ms : opt->respawn_limit_window_ms;
+}
+
+/**
+ * @brief Open the circuit breaker, suspending respawns for the cooldown
+ *
+ * @param inst instance
+ */
+static void breaker_open(instance_t *inst)
+{
+    inst->breaker = RESPAWN_BREAKER_OPEN;
+    inst->respawn_ring_head = 0;
+    inst->respawn_ring_cnt = 0;
+
+    inst->state = INSTANCE_STATE_WAITING;
+    event_timer_start(&inst->timer, respawn_cooldown_ms(inst->svc->opt));
+}
+
+/**
+ * @brief Record a respawn and check it against the respawn limit
+ *
+ * The times of the last N respawns are kept in a ring buffer, so the check
+ * costs O(1): the limit is hit when the oldest of them is still within the
+ * window. A failed trial respawn opens the breaker again at once.
+ *
+ * @param inst instance
+ * @return bool
+ * @retval `true` limit hit, the breaker has been opened
+ * @retval `false` respawn allowed
+ */
+static bool check_respawn_limit(instance_t *inst)
+{
+    const option_t *opt = inst->svc->opt;
+    uint64_t now = event_now_ms();
+
+    if (opt->respawn_limit_burst == 0)
+    {
+        return false;
+    }
+
+    if (inst->breaker == RESPAWN_BREAKER_HALF_OPEN)
+    {
+        // the breaker is closed by the timer once the trial runs for a whole window
+        log_warn("%s failed again after the cooldown, respawning suspended for %llu ms",
+                 inst->name,
+                 (unsigned long long)respawn_cooldown_ms(opt));
+        breaker_open(inst);
+        return true;
+    }
+
+    if (inst->respawn_ring_cnt == opt->respawn_limit_burst)
+    {
+        uint64_t oldest = inst->respawn_ring[inst->respawn_ring_head];
+        if (now - oldest < opt->respawn_limit_window_ms)
+        {
+            log_warn("%s respawned %d times within %llu ms, respawning suspended for %llu ms",
+                     inst->name,
+                     opt->respawn_limit_burst,
+                     (unsigned long long)opt->respawn_limit_window_ms,
+                     (unsigned long long)respawn_cooldown_ms(opt));
+            breaker_open(inst);
+            return true;
+        }
+
+        inst->respawn_ring[inst->respawn_ring_head] = now;
+        inst->respawn_ring_head = (inst->respawn_ring_head + 1) % opt->respawn_limit_burst;
+    }
+    else
+    {
+        inst->respawn_ring[(inst->respawn_ring_head + inst->respawn_ring_cnt) % opt->respawn_limit_burst] = now;
+        inst->respawn_ring_cnt++;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Stop supervising an instance for good
+ *
+ * @param inst instance
+ */
+static void instance_done(instance_t *inst)
+{
+    if (inst->state == INSTANCE_STATE_DONE)
+    {
+        return;
+    }
+
+    event_timer_stop(&inst->timer);
+    inst->state = INSTANCE_STATE_DONE;
+    live_cnt--;
+}
+
+/**
+ * @brief Get the slot of the current process of an instance
+ *
+ * @param inst instance
+ * @return instance_proc_t*
+ */
+static instance_proc_t *current_proc(instance_t *inst)
+{
+    return &inst->procs[inst->cur];
+}
+
+/**
+ * @brief Get the slot of the replacement or previous process of an instance
+ *
+ * @param inst instance
+ * @return instance_proc_t*
+ */
+static instance_proc_t *other_proc(instance_t *inst)
+{
+    return &inst->procs[!inst->cur];
+}
+
+/**
+ * @brief Stop waiting for the readiness of a process
+ *
+ * @param p process slot
+ */
+static void close_ready_pipe(instance_proc_t *p)
+{
+    if (p->ready_event.fd < 0)
+    {
+        return;
+    }
+
+    event_del(&p->ready_event);
+    close(p->ready_event.fd);
+    p->ready_event.fd = -1;
+}
+
+/**
+ * @brief Stop waiting for the cgroup of a slot to empty
+ *
+ * @param p process slot
+ */
+static void close_cgroup_event(instance_proc_t *p)
+{
+    if (p->cgroup_event.fd < 0)
+    {
+        return;
+    }
+
+    event_del(&p->cgroup_event);
+    close(p->cgroup_event.fd);
+    p->cgroup_event.fd = -1;
+}
+
+/**
+ * @brief Check whether a slot is in use, by a process or by what its
+ * process left in its cgroup
+ *
+ * @param p process slot
+ * @return bool
+ */
+static bool slot_in_use(const instance_proc_t *p)
+{
+    return p->proc.pid >= 0 || p->cgroup_event.fd >= 0;
+}
+
+/**
+ * @brief Get the cgroup of a slot
+ *
+ * @param p process slot
+ * @return int O_PATH descriptor, -1 unless the kill mode is cgroup
+ */
+static int slot_cgroup_fd(const instance_proc_t *p)
+{
+    const instance_t *inst = p->inst;
+
+    return inst->svc->opt->plan.replicas[inst->index].cgroup_fds[p - inst->procs];
+}
+
+/**
+ * @brief Send a signal to the process of a slot, and to the processes it
+ * started as the kill mode says
+ *
+ * The target runs in its own session, its pid is its process group id.
+ *
+ * @param p process slot, with a process running
+ * @param signo signal
+ */
+static void kill_tree(instance_proc_t *p, int signo)
+{
+    switch (p->inst->svc->opt->kill_mode)
+    {
+    case KILL_MODE_CGROUP:
+        if (cgroup_kill(slot_cgroup_fd(p), signo) == 0)
+        {
+            break;
+        }
+        // fall through
+    case KILL_MODE_GROUP:
+        if (kill(-p->proc.pid, signo) == 0)
+        {
+            break;
+        }
+        // fall through, the child may not have called setsid() yet
+    case KILL_MODE_PROCESS:
+        kill(p->proc.pid, signo);
+        break;
+    }
+}
+
+/**
+ * @brief Send the signal of the current stop stage to a process
+ *
+ * Arms the timer to escalate to the next stage, unless it is the last one.
+ *
+ * @param p process slot
+ */
+static void send_stop_signal(instance_proc_t *p)
+{
+    const option_t *opt = p->inst->svc->opt;
+    const stop_stage_t *stage = &opt->stop_stages[p->stop_stage];
+
+    kill_tree(p, stage->signo);
+
+    if (p->stop_stage + 1 < opt->stop_stage_cnt)
+    {
+        event_timer_start(&p->timer, stage->timeout_ms);
+    }
+}
+
+/**
+ * @brief Gracefully stop a process
+ *
+ * Sends the signals of the configured stop sequence in turn, escalating to
+ * the next one whenever the stage timeout expires, SIGKILL being the last
+ * one. Returns immediately; the exit of the process is reported by the
+ * process watcher, which also cancels the escalation.
+ *
+ * @param p process slot
+ */
+static void stop_proc(instance_proc_t *p)
+{
+    if (p->proc.pid < 0 || p->stopping)
+    {
+        return;
+    }
+
+    event_timer_stop(&p->timer);
+    event_timer_stop(&p->watchdog_timer);
+    close_ready_pipe(p);
+
+    p->stopping = true;
+    p->stop_stage = 0;
+    p->stop_started_ms = event_now_ms();
+
+    send_stop_signal(p);
+}
+
+/**
+ * @brief Make the replacement process of an instance its current process
+ *
+ * The previous process, if still running, is stopped gracefully.
+ *
+ * @param inst instance
+ */
+static void complete_restart(instance_t *inst)
+{
+    instance_proc_t *prev = current_proc(inst);
+
+    inst->cur = !inst->cur;
+    inst->restarting = false;
+
+    instance_proc_t *p = current_proc(inst);
+
+    // cancel the readiness deadline
+    event_timer_stop(&p->timer);
+
+    // failures, latencies and RSS of the previous process do not count against this one
+    inst->health_failures = 0;
+    histogram_reset(&inst->latency_window);
+    rss_trend_reset(&inst->rss_trend);
+
+    if (prev->proc.pid >= 0)
+    {
+        log_info("restarted %s, pid %d replaces pid %d", inst->name, p->proc.pid, prev->proc.pid);
+        stop_proc(prev);
+    }
+}
+
+/**
+ * @brief Check whether the resource usage of the targets of a service is sampled
+ *
+ * @param opt option
+ * @return bool
+ */
+static bool uses_resource_limits(const option_t *opt)
+{
+    return opt->max_rss_bytes > 0 || opt->max_cpu_percent > 0;
+}
+
+/**
+ * @brief Check whether an instance is moved between cores by the rebalancing
+ *
+ * @param inst instance
+ * @return bool
+ */
+static bool uses_rebalance(const instance_t *inst)
+{
+    return rebalance_ms > 0 && inst->svc->opt->plan.replicas[inst->index].core >= 0;
+}
+
+/**
+ * @brief Handle the readiness of a process
+ *
+ * @param p process slot
+ */
+static void proc_ready(instance_proc_t *p)
+{
+    instance_t *inst = p->inst;
+
+    p->ready = true;
+    p->ready_after_ms = event_now_ms() - p->started_ms;
+
+    log_info("%s is ready after %llu ms, pid: %d",
+             inst->name,
+             (unsigned long long)p->ready_after_ms,
+             p->proc.pid);
+
+    if (inst->restarting && p == other_proc(inst))
+    {
+        complete_restart(inst);
+    }
+}
+
+/**
+ * @brief Handle the readiness pipe of a process
+ *
+ * Any data written by the target means it is ready. The pipe is closed
+ * afterwards, as well as when the target closes its end without writing.
+ *
+ * @param ev event
+ * @param events ready events
+ */
+static void ready_handler(event_t *ev, uint32_t events)
+{
+    instance_proc_t *p = ev->data;
+    char buf[64];
+
+    ssize_t len = read(ev->fd, buf, sizeof(buf));
+    if (len < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+        return;
+    }
+
+    close_ready_pipe(p);
+
+    if (len > 0)
+    {
+        proc_ready(p);
+    }
+}
+
+/**
+ * @brief Spawn the target process into a slot of an instance
+ *
+ * @param p process slot, must be free
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+static int spawn_proc(instance_proc_t *p)
+{
+    instance_t *inst = p->inst;
+    const option_t *opt = inst->svc->opt;
+    int ready_pipe[2] = {-1, -1};
+    int pidfd;
+
+    if (opt->ready_fd >= 0 && pipe2(ready_pipe, O_CLOEXEC | O_NONBLOCK) < 0)
+    {
+        log_error("failed to create pipe: %s", strerror(errno));
+        return -1;
+    }
+
+    pid_t pid = spawn_process(opt, inst->index, (int)(p - inst->procs), &child_sigmask, ready_pipe[1], &pidfd);
+
+    if (ready_pipe[1] >= 0)
+    {
+        close(ready_pipe[1]);
+    }
+
+    if (pid < 0)
+    {
+        if (ready_pipe[0] >= 0)
+        {
+            close(ready_pipe[0]);
+        }
+        return -1;
+    }
+
+    if (proc_watch(&p->proc, pid, pidfd) < 0)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+
+        if (ready_pipe[0] >= 0)
+        {
+            close(ready_pipe[0]);
+        }
+        p->proc.pid = -1;
+        return -1;
+    }
+
+    running_cnt++;
+
+    p->started_ms = event_now_ms();
+    p->stopping = false;
+    p->ready = false;
+    p->ready_after_ms = 0;
+    p->main_pid = 0;
+    p->reloading = false;
+    p->status[0] = '\0';
+    p->unhealthy = false;
+
+    if (opt->watchdog_ms > 0)
+    {
+        p->watchdog_ms = p->started_ms;
+        event_timer_start(&p->watchdog_timer, opt->watchdog_ms);
+    }
+
+    p->rss_bytes = 0;
+    p->cpu_percent = -1;
+    p->cpu_window_started_ms = p->started_ms;
+    p->cpu_window_start_us = 0;
+
+    // the process is then sampled without opening anything
+    if (uses_resource_limits(opt) || uses_rebalance(inst))
+    {
+        resource_sampler_open(&p->sampler, pid, opt->max_cpu_percent > 0 || uses_rebalance(inst));
+    }
+
+    log_info("started %s, pid: %d", inst->name, pid);
+
+    if (ready_pipe[0] >= 0)
+    {
+        p->ready_event.fd = ready_pipe[0];
+        if (event_add(&p->ready_event, EPOLLIN) < 0)
+        {
+            close(ready_pipe[0]);
+            p->ready_event.fd = -1;
+        }
+    }
+    else if (!opt->notify)
+    {
+        // without notification, a target is ready once it is executed
+        p->ready = true;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Start probing the health of the current process of an instance
+ *
+ * @param inst instance
+ */
+static void health_start(instance_t *inst)
+{
+    const option_t *opt = inst->svc->opt;
+
+    if (opt->health_probe == HEALTH_PROBE_NONE)
+    {
+        return;
+    }
+
+    inst->health_failures = 0;
+    histogram_reset(&inst->latency_window);
+    event_timer_start(&inst->health_timer, opt->health_interval_ms);
+}
+
+/**
+ * @brief Stop probing the health of an instance
+ *
+ * @param inst instance
+ */
+static void health_stop(instance_t *inst)
+{
+    event_timer_stop(&inst->health_timer);
+    health_check_cancel(&inst->health);
+}
+
+/**
+ * @brief Run a health probe when it is due
+ *
+ * Probes wait until the current process is ready.
+ *
+ * @param timer health timer
+ */
+static void health_timer_handler(event_timer_t *timer)
+{
+    instance_t *inst = timer->data;
+    instance_proc_t *p = current_proc(inst);
+
+    if (inst->state != INSTANCE_STATE_RUNNING)
+    {
+        return;
+    }
+
+    if (!p->ready || p->stopping)
+    {
+        event_timer_start(timer, inst->svc->opt->health_interval_ms);
+        return;
+    }
+
+    health_check_run(&inst->health, &child_sigmask);
+}
+
+/**
+ * @brief Record the latency of a successful probe
+ *
+ * Once HEALTH_LATENCY_WINDOW probes are recorded, the target is restarted
+ * without downtime if their p99 exceeds `restart_p99_ms`.
+ *
+ * @param inst instance
+ * @param us probe latency in microseconds
+ */
+static void health_record_latency(instance_t *inst, uint64_t us)
+{
+    const option_t *opt = inst->svc->opt;
+
+    histogram_record(&inst->svc->latency, us);
+
+    if (opt->restart_p99_ms == 0)
+    {
+        return;
+    }
+
+    histogram_record(&inst->latency_window, us);
+    if (inst->latency_window.total < HEALTH_LATENCY_WINDOW)
+    {
+        return;
+    }
+
+    uint64_t p99_us = histogram_percentile(&inst->latency_window, 99);
+    histogram_reset(&inst->latency_window);
+
+    if (p99_us > opt->restart_p99_ms * 1000)
+    {
+        log_warn("%s probe p99 latency %llu us exceeds %llu ms",
+                 inst->name,
+                 (unsigned long long)p99_us,
+                 (unsigned long long)opt->restart_p99_ms);
+        instance_restart(inst);
+    }
+}
+
+/**
+ * @brief Handle the result of a health probe
+ *
+ * The current process is stopped and respawned after `health_retries`
+ * consecutive failures.
+ *
+ * @param check health check
+ * @param ok whether the probe succeeded
+ * @param reason cause of the failure
+ */
+static void health_result_handler(health_check_t *check, bool ok, const char *reason)
+{
+    instance_t *inst = check->data;
+    const option_t *opt = inst->svc->opt;
+
+    if (inst->state != INSTANCE_STATE_RUNNING)
+    {
+        return;
+    }
+
+    if (ok)
+    {
+        if (inst->health_failures > 0)
+        {
+            log_info("%s is healthy again", inst->name);
+        }
+        inst->health_failures = 0;
+
+        health_record_latency(inst, check->latency_us);
+    }
+    else
+    {
+        inst->svc->probe_failures++;
+        inst->health_failures++;
+        log_warn("%s health probe failed (%d/%d): %s",
+                 inst->name,
+                 inst->health_failures,
+                 opt->health_retries,
+                 reason);
+
+        if (inst->health_failures >= opt->health_retries)
+        {
+            instance_proc_t *p = current_proc(inst);
+
+            log_warn("%s (pid %d) is unhealthy; stopping it", inst->name, p->proc.pid);
+
+            p->unhealthy = true;
+            stop_proc(p);
+            return;
+        }
+    }
+
+    event_timer_start(&inst->health_timer, opt->health_interval_ms);
+}
+
+/**
+ * @brief Stop the current process of an instance over a resource limit
+ *
+ * @param inst instance
+ * @param what description of the usage over the limit
+ */
+static void resource_exceeded(instance_t *inst, const char *what)
+{
+    instance_proc_t *p = current_proc(inst);
+
+    log_warn("%s (pid %d) %s; stopping it", inst->name, p->proc.pid, what);
+
+    p->unhealthy = true;
+    stop_proc(p);
+}
+
+/**
+ * @brief Recycle the current process of an instance before its RSS reaches
+ * the limit
+ *
+ * The process is restarted without downtime when the RSS trend reaches
+ * `max_rss_bytes` within `recycle_horizon_ms`. Only one instance of a
+ * service is restarted at a time, the others wait for their next sample.
+ *
+ * @param inst instance
+ */
+static void check_rss_trend(instance_t *inst)
+{
+    const option_t *opt = inst->svc->opt;
+    uint64_t eta_ms;
+    double bytes_per_s;
+
+    if (inst->restarting ||
+        rss_trend_eta(&inst->rss_trend, opt->max_rss_bytes, &eta_ms, &bytes_per_s) < 0 ||
+        eta_ms >= opt->recycle_horizon_ms)
+    {
+        return;
+    }
+
+    for (int i = 0; i < inst->svc->instance_cnt; i++)
+    {
+        instance_t *peer = &inst->svc->instances[i];
+
+        if (peer->restarting || slot_in_use(other_proc(peer)))
+        {
+            return;
+        }
+    }
+
+    log_warn("%s (pid %d) RSS grows %.0f KiB/s and reaches %llu KiB in %llu s; recycling it",
+             inst->name,
+             current_proc(inst)->proc.pid,
+             bytes_per_s / 1024,
+             (unsigned long long)(opt->max_rss_bytes / 1024),
+             (unsigned long long)(eta_ms / 1000));
+
+    // a failed restart is tried again once a new trend is sampled
+    rss_trend_reset(&inst->rss_trend);
+    instance_restart(inst);
+}
+
+/**
+ * @brief Sample the resource usage of the current process of an instance
+ *
+ * The RSS is checked on every sample, the CPU usage once a whole window is
+ * sampled. A process over a limit is stopped with the stop sequence and
+ * respawned, like a hung one.
+ *
+ * @param timer resource timer
+ */
+static void resource_timer_handler(event_timer_t *timer)
+{
+    instance_t *inst = timer->data;
+    const option_t *opt = inst->svc->opt;
+    instance_proc_t *p = current_proc(inst);
+    uint64_t cpu_us;
+    char what[96];
+
+    if (inst->state != INSTANCE_STATE_RUNNING)
+    {
+        return;
+    }
+
+    event_timer_start(timer, RESOURCE_SAMPLE_MS);
+
+    if (p->stopping || p->sampler.fd < 0 || resource_sampler_read(&p->sampler, &p->rss_bytes, &cpu_us) < 0)
+    {
+        return;
+    }
+
+    if (opt->max_rss_bytes > 0 && p->rss_bytes > opt->max_rss_bytes)
+    {
+        snprintf(what, sizeof(what), "RSS %llu KiB exceeds %llu KiB",
+                 (unsigned long long)(p->rss_bytes / 1024),
+                 (unsigned long long)(opt->max_rss_bytes / 1024));
+        resource_exceeded(inst, what);
+        return;
+    }
+
+    uint64_t now = event_now_ms();
+
+    if (opt->recycle_horizon_ms > 0)
+    {
+        rss_trend_add(&inst->rss_trend, now, p->rss_bytes);
+        check_rss_trend(inst);
+    }
+
+    if (opt->max_cpu_percent == 0 || now - p->cpu_window_started_ms < opt->max_cpu_window_ms)
+    {
+        return;
+    }
+
+    p->cpu_percent = (cpu_us - p->cpu_window_start_us) / 10 / (now - p->cpu_window_started_ms);
+    p->cpu_window_started_ms = now;
+    p->cpu_window_start_us = cpu_us;
+
+    if (p->cpu_percent > opt->max_cpu_percent)
+    {
+        snprintf(what, sizeof(what), "CPU usage %d%% exceeds %d%% over %llu ms",
+                 p->cpu_percent,
+                 opt->max_cpu_percent,
+                 (unsigned long long)opt->max_cpu_window_ms);
+        resource_exceeded(inst, what);
+    }
+}
+
+/**
+ * @brief Move instances between the cores of their node to even out the CPU
+ * load
+ *
+ * The current process of every instance spread by --cpus=auto is sampled
+ * each round. A process is moved once sampled over a whole round, and then
+ * stays on its new core for REBALANCE_HOLD_ROUNDS rounds.
+ *
+ * @param timer rebalance timer
+ */
+static void rebalance_timer_handler(event_timer_t *timer)
+{
+    uint64_t now = event_now_ms();
+    uint64_t elapsed_ms = now - rebalance_last_ms;
+    size_t capacity = 0;
+    int cnt = 0;
+
+    event_timer_start(timer, rebalance_ms);
+    rebalance_last_ms = now;
+
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        capacity += services[i]->instance_cnt;
+    }
+
+    affinity_load_t *loads = calloc(capacity, sizeof(affinity_load_t));
+    if (!loads || elapsed_ms == 0)
+    {
+        free(loads);
+        return;
+    }
+
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        service_t *svc = services[i];
+
+        for (int j = 0; j < svc->instance_cnt; j++)
+        {
+            instance_t *inst = &svc->instances[j];
+            instance_proc_t *p = current_proc(inst);
+            uint64_t rss_bytes;
+            uint64_t cpu_us;
+
+            if (!uses_rebalance(inst) || inst->state != INSTANCE_STATE_RUNNING || p->stopping ||
+                p->sampler.fd < 0 || resource_sampler_read(&p->sampler, &rss_bytes, &cpu_us) < 0)
+            {
+                continue;
+            }
+
+            if (inst->balance_pid != p->proc.pid)
+            {
+                // first sample of this process
+                inst->balance_pid = p->proc.pid;
+                inst->balance_cpu_us = cpu_us;
+                continue;
+            }
+
+            affinity_load_t *load = &loads[cnt++];
+
+            load->replica = &svc->opt->plan.replicas[inst->index];
+            load->pid = p->proc.pid;
+            load->cpu_us = cpu_us - inst->balance_cpu_us;
+            load->movable = now - inst->balance_moved_ms >= REBALANCE_HOLD_ROUNDS * rebalance_ms;
+            load->data = inst;
+
+            inst->balance_cpu_us = cpu_us;
+        }
+    }
+
+    if (affinity_rebalance(loads, cnt, rebalance_moves, elapsed_ms * 10 * REBALANCE_MIN_GAIN_PERCENT) > 0)
+    {
+        for (int i = 0; i < cnt; i++)
+        {
+            instance_t *inst = loads[i].data;
+            char cpus[128];
+
+            if (!loads[i].moved)
+            {
+                continue;
+            }
+
+            inst->balance_moved_ms = now;
+            inst->migration_cnt++;
+
+            cpu_list_format(&loads[i].replica->cpus, cpus, sizeof(cpus));
+            log_info("moved %s to CPUs %s, load: %llu%%",
+                     inst->name,
+                     cpus,
+                     (unsigned long long)(loads[i].cpu_us / 10 / elapsed_ms));
+        }
+    }
+
+    free(loads);
+}
+
+/**
+ * @brief Spawn the current process of an instance
+ *
+ * When the target cannot be spawned, every instance of its service is
+ * stopped; the other services keep running.
+ *
+ * @param inst instance
+ */
+static void instance_spawn(instance_t *inst)
+{
+    const option_t *opt = inst->svc->opt;
+
+    if (spawn_proc(current_proc(inst)) < 0)
+    {
+        log_error("failed to start %s, stopping %s", inst->name, inst->svc->name);
+        exit_code = EXIT_FAILURE;
+        instance_done(inst);
+        service_shutdown(inst->svc);
+        return;
+    }
+
+    inst->state = INSTANCE_STATE_RUNNING;
+
+    health_start(inst);
+
+    if (uses_resource_limits(opt))
+    {
+        rss_trend_reset(&inst->rss_trend);
+        event_timer_start(&inst->resource_timer, RESOURCE_SAMPLE_MS);
+    }
+
+    if (inst->breaker == RESPAWN_BREAKER_HALF_OPEN)
+    {
+        event_timer_start(&inst->timer, opt->respawn_limit_window_ms);
+    }
+}
+
+/**
+ * @brief Respawn the target of an instance waiting to respawn
+ *
+ * @param inst instance
+ */
+static void instance_respawn(instance_t *inst)
+{
+    event_timer_stop(&inst->timer);
+
+    if (inst->breaker == RESPAWN_BREAKER_OPEN)
+    {
+        log_info("%s cooldown ended, trying to respawn", inst->name);
+        inst->breaker = RESPAWN_BREAKER_HALF_OPEN;
+    }
+
+    instance_spawn(inst);
+}
+
+/**
+ * @brief Handle the timer of an instance
+ *
+ * Respawns the target after the respawn delay or the cooldown, or closes the
+ * breaker when a trial respawn ran for a whole window.
+ *
+ * @param timer instance timer
+ */
+static void instance_timer_handler(event_timer_t *timer)
+{
+    instance_t *inst = timer->data;
+
+    switch (inst->state)
+    {
+    case INSTANCE_STATE_WAITING:
+        instance_respawn(inst);
+        break;
+
+    case INSTANCE_STATE_RUNNING:
+        // the trial respawn survived a whole window
+        log_info("%s is running steadily again, respawn limit reset", inst->name);
+        inst->breaker = RESPAWN_BREAKER_CLOSED;
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Handle the timer of a process
+ *
+ * Escalates to the next stop stage when the process did not exit in time,
+ * or rolls a restart back when the replacement did not become ready in time.
+ *
+ * @param timer process timer
+ */
+static void proc_timer_handler(event_timer_t *timer)
+{
+    instance_proc_t *p = timer->data;
+    instance_t *inst = p->inst;
+    const option_t *opt = inst->svc->opt;
+
+    if (p->stopping)
+    {
+        const stop_stage_t *stage = &opt->stop_stages[p->stop_stage];
+
+        p->stop_stage++;
+        log_warn("%s (pid %d) did not exit within %llu ms after %s; sending %s",
+                 inst->name,
+                 p->proc.pid,
+                 (unsigned long long)stage->timeout_ms,
+                 strsignal(stage->signo),
+                 strsignal(opt->stop_stages[p->stop_stage].signo));
+
+        send_stop_signal(p);
+        return;
+    }
+
+    if (inst->restarting && p == other_proc(inst))
+    {
+        log_warn("replacement of %s (pid %d) not ready within %llu ms, keeping pid %d",
+                 inst->name,
+                 p->proc.pid,
+                 (unsigned long long)opt->ready_timeout_ms,
+                 current_proc(inst)->proc.pid);
+
+        inst->restarting = false;
+        stop_proc(p);
+    }
+}
+
+/**
+ * @brief Stop a process found hung by the watchdog
+ *
+ * The process goes through the stop sequence, and is respawned once it exits.
+ *
+ * @param p process slot
+ */
+static void watchdog_expired(instance_proc_t *p)
+{
+    log_warn("%s (pid %d) hung, no keep-alive for %llu ms; stopping it",
+             p->inst->name,
+             p->proc.pid,
+             (unsigned long long)(event_now_ms() - p->watchdog_ms));
+
+    p->unhealthy = true;
+    stop_proc(p);
+}
+
+/**
+ * @brief Handle the watchdog timer of a process
+ *
+ * Keep-alives only record their time, so the deadline is moved forward here
+ * when a keep-alive came in since the timer was armed.
+ *
+ * @param timer watchdog timer
+ */
+static void watchdog_timer_handler(event_timer_t *timer)
+{
+    instance_proc_t *p = timer->data;
+    const option_t *opt = p->inst->svc->opt;
+    uint64_t idle_ms = event_now_ms() - p->watchdog_ms;
+
+    if (idle_ms < opt->watchdog_ms)
+    {
+        event_timer_start(timer, opt->watchdog_ms - idle_ms);
+        return;
+    }
+
+    watchdog_expired(p);
+}
+
+/**
+ * @brief Handle the exit of a process that is not the current one
+ *
+ * Either a previous process stopped after a restart, or a replacement exited
+ * before becoming ready, which rolls the restart back.
+ *
+ * @param p process slot
+ * @param pid process ID of the exited process
+ */
+static void other_proc_exited(instance_proc_t *p, pid_t pid)
+{
+    instance_t *inst = p->inst;
+
+    if (inst->restarting)
+    {
+        inst->restarting = false;
+        log_warn("replacement of %s (pid %d) exited before becoming ready, keeping pid %d",
+                 inst->name,
+                 pid,
+                 current_proc(inst)->proc.pid);
+    }
+    else if (p->stopping)
+    {
+        log_info("%s (pid %d) stopped in %llu ms",
+                 inst->name,
+                 pid,
+                 (unsigned long long)(event_now_ms() - p->stop_started_ms));
+    }
+}
+
+/**
+ * @brief Handle the exit of a process of an instance, once the processes it
+ * left behind are gone
+ *
+ * @param p process slot, with `exit_pid` and `exit_status` set
+ */
+static void proc_exited(instance_proc_t *p)
+{
+    instance_t *inst = p->inst;
+    const option_t *opt = inst->svc->opt;
+    bool respawn_required = opt->respawn;
+    uint64_t uptime_ms = event_now_ms() - p->started_ms;
+    pid_t pid = p->exit_pid;
+    int status = p->exit_status;
+
+    running_cnt--;
+
+    if (p != current_proc(inst))
+    {
+        other_proc_exited(p, pid);
+        p->stopping = false;
+        return;
+    }
+
+    if (p->stopping)
+    {
+        log_info("%s stopped in %llu ms", inst->name, (unsigned long long)(event_now_ms() - p->stop_started_ms));
+        p->stopping = false;
+    }
+
+    if (inst->restarting)
+    {
+        // the replacement is already starting, let it take over
+        log_warn("%s exited during restart, pid %d takes over", inst->name, other_proc(inst)->proc.pid);
+        complete_restart(inst);
+        return;
+    }
+
+    event_timer_stop(&inst->timer);
+    health_stop(inst);
+    event_timer_stop(&inst->resource_timer);
+
+    if (shutting_down || inst->svc->stopped)
+    {
+        instance_done(inst);
+        return;
+    }
+
+    // check the exit status of the child process
+    if (WIFEXITED(status))
+    {
+        // child exited normally
+        // check if respawn is needed
+        log_warn("%s exited, status: %d", inst->name, WEXITSTATUS(status));
+        respawn_required = check_respawn_required(opt, WEXITSTATUS(status));
+    }
+    else if (WIFSIGNALED(status))
+    {
+        // child terminated by a signal
+        log_warn("%s exited, signal: %s (%d)", inst->name, strsignal(WTERMSIG(status)), WTERMSIG(status));
+    }
+    else
+    {
+        // child exited abnormally without a clear signal or exit status
+        log_warn("%s exited abnormal", inst->name);
+    }
+
+    // an unhealthy target is restarted, whatever it exited with once stopped
+    if (p->unhealthy)
+    {
+        respawn_required = true;
+    }
+
+    // a target that ran steadily starts over with a clean record
+    if (opt->respawn_reset_ms && uptime_ms >= opt->respawn_reset_ms)
+    {
+        inst->respawn_cnt = 0;
+        inst->backoff_level = 0;
+    }
+
+    // increment respawn counter and check against the configured maximum
+    inst->respawn_cnt++;
+    if (opt->max_respawn_cnt && inst->respawn_cnt > opt->max_respawn_cnt)
+    {
+        log_info("maximum respawn attempts reached for %s", inst->name);
+        instance_done(inst);
+        return;
+    }
+
+    // stop supervising if respawning is not required
+    if (!respawn_required)
+    {
+        instance_done(inst);
+        return;
+    }
+
+    if (check_respawn_limit(inst))
+    {
+        return;
+    }
+
+    uint64_t delay_ms = respawn_delay_ms(inst);
+    if (delay_ms > 0)
+    {
+        log_info("%s respawning in %llu ms", inst->name, (unsigned long long)delay_ms);
+
+        inst->state = INSTANCE_STATE_WAITING;
+        event_timer_start(&inst->timer, delay_ms);
+    }
+    else
+    {
+        log_info("%s respawning immediately", inst->name);
+        instance_spawn(inst);
+    }
+}
+
+/**
+ * @brief Called when cgroup.events of a slot changes, until the cgroup is empty
+ *
+ * @param ev event
+ * @param events ready events
+ */
+static void cgroup_event_handler(event_t *ev, uint32_t events)
+{
+    instance_proc_t *p = ev->data;
+
+    if (cgroup_populated(ev->fd) == 1)
+    {
+        return;
+    }
+
+    log_info("%s: processes left by pid %d killed", p->inst->name, p->exit_pid);
+
+    close_cgroup_event(p);
+    proc_exited(p);
+}
+
+/**
+ * @brief Kill the processes the exited process of a slot left behind
+ *
+ * With kill mode group, the rest of its process group is killed. With kill
+ * mode cgroup, the cgroup of the slot is killed at once, and the exit is
+ * handled only when cgroup.events reports it empty, so that the respawn
+ * does not race the previous tree for its ports.
+ *
+ * @param p process slot, with `exit_pid` set
+ * @return int
+ * @retval `0` the exit can be handled
+ * @retval `1` waiting for the cgroup to empty
+ */
+static int kill_leftovers(instance_proc_t *p)
+{
+    const option_t *opt = p->inst->svc->opt;
+
+    if (opt->kill_mode == KILL_MODE_GROUP)
+    {
+        // a group outlives its leader as long as it has members
+        kill(-p->exit_pid, SIGKILL);
+        return 0;
+    }
+
+    if (opt->kill_mode != KILL_MODE_CGROUP)
+    {
+        return 0;
+    }
+
+    p->cgroup_event.fd = cgroup_events_open(slot_cgroup_fd(p));
+    if (p->cgroup_event.fd < 0)
+    {
+        return 0;
+    }
+
+    // watched before it is read, so that the cgroup emptying in between is reported
+    if (event_add(&p->cgroup_event, EPOLLPRI) < 0)
+    {
+        close(p->cgroup_event.fd);
+        p->cgroup_event.fd = -1;
+        return 0;
+    }
+
+    if (cgroup_populated(p->cgroup_event.fd) != 1)
+    {
+        close_cgroup_event(p);
+        return 0;
+    }
+
+    if (cgroup_kill(slot_cgroup_fd(p), SIGKILL) < 0)
+    {
+        close_cgroup_event(p);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Called by the process watcher when a process of an instance terminates
+ *
+ * @param proc process
+ * @param status status from waitpid()
+ */
+static void proc_exit_handler(proc_t *proc, int status)
+{
+    instance_proc_t *p = proc->data;
+
+    event_timer_stop(&p->timer);
+    event_timer_stop(&p->watchdog_timer);
+    close_ready_pipe(p);
+    resource_sampler_close(&p->sampler);
+
+    p->exit_pid = p->proc.pid;
+    p->exit_status = status;
+    p->proc.pid = -1;
+
+    if (kill_leftovers(p) == 0)
+    {
+        proc_exited(p);
+    }
+}
+
+/**
+ * @brief Restart the target of an instance without downtime
+ *
+ * A replacement is spawned next to the current process, which is only
+ * stopped once the replacement is ready. The restart is rolled back if the
+ * replacement exits or is not ready within the ready timeout. A target
+ * waiting to respawn is respawned at once.
+ *
+ * @param inst instance
+ * @return int
+ * @retval `0` restart started
+ * @retval `-1` not restartable in its current state
+ */
+static int instance_restart(instance_t *inst)
+{
+    const option_t *opt = inst->svc->opt;
+
+    if (shutting_down || inst->svc->stopped)
+    {
+        return -1;
+    }
+
+    if (inst->state == INSTANCE_STATE_WAITING)
+    {
+        instance_respawn(inst);
+        return 0;
+    }
+
+    // a restart is in progress or the previous process is still stopping
+    if (inst->state != INSTANCE_STATE_RUNNING || slot_in_use(other_proc(inst)))
+    {
+        return -1;
+    }
+
+    instance_proc_t *p = other_proc(inst);
+
+    log_info("restarting %s, pid: %d", inst->name, current_proc(inst)->proc.pid);
+
+    if (spawn_proc(p) < 0)
+    {
+        return -1;
+    }
+
+    inst->restarting = true;
+
+    if (p->ready)
+    {
+        complete_restart(inst);
+    }
+    else
+    {
+        event_timer_start(&p->timer, opt->ready_timeout_ms);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Gracefully shut down the target of an instance
+ *
+ * A replacement being started by a restart is stopped as well.
+ *
+ * @param inst instance
+ */
+static void graceful_shutdown(instance_t *inst)
+{
+    if (inst->state != INSTANCE_STATE_RUNNING)
+    {
+        return;
+    }
+
+    log_info("graceful shutdown %s", inst->name);
+
+    // cancel the end of a breaker trial
+    event_timer_stop(&inst->timer);
+
+    inst->state = INSTANCE_STATE_STOPPING;
+
+    health_stop(inst);
+    event_timer_stop(&inst->resource_timer);
+
+    if (inst->restarting)
+    {
+        inst->restarting = false;
+        stop_proc(other_proc(inst));
+    }
+
+    stop_proc(current_proc(inst));
+}
+
+/**
+ * @brief Initialize supervisor
+ *
+ * @param sigmask signal mask to restore in spawned children
+ * @return int
+ * @retval `0` ok
+ */
+int supervisor_init(const sigset_t *sigmask)
+{
+    child_sigmask = *sigmask;
+
+    // seed the respawn jitter
+    srandom((unsigned int)(event_now_ms() ^ getpid()));
+
+    return 0;
+}
+
+/**
+ * @brief Enable the CPU load rebalancing of the instances spread by
+ * --cpus=auto, started with the supervisor
+ *
+ * @param interval_ms interval between two rounds
+ * @param max_moves most instances moved per round
+ */
+void supervisor_rebalance_init(uint64_t interval_ms, int max_moves)
+{
+    rebalance_ms = interval_ms;
+    rebalance_moves = max_moves;
+
+    rebalance_timer.handler = rebalance_timer_handler;
+    rebalance_timer.data = NULL;
+}
+
+/**
+ * @brief Add a service to supervise
+ *
+ * @param opt option of the service, must outlive the supervisor
+ * @return int
+ * @retval `0` ok
+ * @retval `-1` failed
+ */
+int supervisor_add_service(option_t *opt)
+{
+    // rund now holds its pid file, the listeners and cgroup are its own
+    if (spawn_plan_open(&opt->plan, opt) < 0)
+    {
+        return -1;
+    }
+
+    service_t **temp = realloc(services, (service_cnt + 1) * sizeof(service_t *));
+    if (!temp)
+    {
+        log_error("failed to realloc: %s", strerror(errno));
+        return -1;
+    }
+
+    services = temp;
+
+    service_t *svc = calloc(1, sizeof(service_t));
+    if (!svc)
+    {
+        log_error("failed to calloc: %s", strerror(errno));
+        return -1;
+    }
+
+    svc->opt = opt;
+    svc->name = opt->name ? opt->name : opt->target;
+    svc->instance_cnt = opt->replica_cnt;
+    svc->instances = calloc(svc->instance_cnt, sizeof(instance_t));
+    if (!svc->instances)
+    {
+        log_error("failed to calloc: %s", strerror(errno));
+        free(svc);
+        return -1;
+    }
+
+    for (int i = 0; i < svc->instance_cnt; i++)
+    {
+        instance_t *inst = &svc->instances[i];
+
+        inst->svc = svc;
+        inst->index = i;
+        inst->state = INSTANCE_STATE_IDLE;
+
+        for (int k = 0; k < 2; k++)
+        {
+            instance_proc_t *p = &inst->procs[k];
+
+            p->inst = inst;
+
+            p->proc.pid = -1;
+            p->proc.pidfd = -1;
+            p->proc.event.fd = -1;
+            p->proc.on_exit = proc_exit_handler;
+            p->proc.data = p;
+
+            p->ready_event.fd = -1;
+            p->ready_event.handler = ready_handler;
+            p->ready_event.data = p;
+
+            p->timer.handler = proc_timer_handler;
+            p->timer.data = p;
+
+            p->watchdog_timer.handler = watchdog_timer_handler;
+            p->watchdog_timer.data = p;
+
+            p->sampler.fd = -1;
+
+            p->cgroup_event.fd = -1;
+            p->cgroup_event.handler = cgroup_event_handler;
+            p->cgroup_event.data = p;
+        }
+
+        inst->timer.handler = instance_timer_handler;
+        inst->timer.data = inst;
+
+        health_check_init(&inst->health, opt, i);
+        inst->health.on_result = health_result_handler;
+        inst->health.data = inst;
+
+        inst->health_timer.handler = health_timer_handler;
+        inst->health_timer.data = inst;
+
+        inst->resource_timer.handler = resource_timer_handler;
+        inst->resource_timer.data = inst;
+
+        if (opt->respawn_limit_burst > 0)
+        {
+            inst->respawn_ring = calloc(opt->respawn_limit_burst, sizeof(uint64_t));
+        }
+
+        if (opt->recycle_horizon_ms > 0)
+        {
+            inst->rss_trend.samples = calloc(RSS_TREND_SAMPLES, sizeof(rss_sample_t));
+        }
+
+        if (svc->instance_cnt > 1)
+        {
+            if (asprintf(&inst->name, "%s#%d", svc->name, i) < 0)
+            {
+                inst->name = NULL;
+            }
+        }
+        else
+        {
+            inst->name = strdup(svc->name);
+        }
+
+        if (!inst->name || (opt->respawn_limit_burst > 0 && !inst->respawn_ring) ||
+            (opt->recycle_horizon_ms > 0 && !inst->rss_trend.samples))
+        {
+            log_error("failed to allocate instance: %s", strerror(errno));
+            for (int j = 0; j <= i; j++)
+            {
+                free(svc->instances[j].name);
+                free(svc->instances[j].respawn_ring);
+                free(svc->instances[j].rss_trend.samples);
+            }
+            free(svc->instances);
+            free(svc);
+            return -1;
+        }
+    }
+
+    services[service_cnt++] = svc;
+    live_cnt += svc->instance_cnt;
+
+    return 0;
+}
+
+/**
+ * @brief Spawn all instances of all services
+ *
+ */
+void supervisor_start(void)
+{
+    for (size_t i = 0; i < service_cnt && !shutting_down; i++)
+    {
+        service_t *svc = services[i];
+
+        for (int j = 0; j < svc->instance_cnt && !svc->stopped; j++)
+        {
+            instance_spawn(&svc->instances[j]);
+        }
+    }
+
+    if (rebalance_ms > 0 && !shutting_down)
+    {
+        rebalance_last_ms = event_now_ms();
+        event_timer_start(&rebalance_timer, rebalance_ms);
+    }
+}
+
+/**
+ * @brief Stop all instances of a service
+ *
+ * Running targets are shut down gracefully, pending respawns are cancelled.
+ *
+ * @param svc service
+ */
+static void service_shutdown(service_t *svc)
+{
+    svc->stopped = true;
+
+    for (int i = 0; i < svc->instance_cnt; i++)
+    {
+        instance_t *inst = &svc->instances[i];
+
+        switch (inst->state)
+        {
+        case INSTANCE_STATE_RUNNING:
+            graceful_shutdown(inst);
+            break;
+
+        case INSTANCE_STATE_IDLE:
+        case INSTANCE_STATE_WAITING:
+            instance_done(inst);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Stop all instances
+ *
+ * The supervisor is finished once every target has exited.
+ *
+ */
+void supervisor_shutdown(void)
+{
+    if (shutting_down)
+    {
+        return;
+    }
+
+    shutting_down = true;
+
+    event_timer_stop(&rebalance_timer);
+
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        service_shutdown(services[i]);
+    }
+}
+
+/**
+ * @brief Send a signal to the target process of every running instance
+ *
+ * @param sig signal number
+ */
+void supervisor_signal_all(int sig)
+{
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        service_t *svc = services[i];
+
+        for (int j = 0; j < svc->instance_cnt; j++)
+        {
+            instance_t *inst = &svc->instances[j];
+
+            if (inst->state == INSTANCE_STATE_RUNNING)
+            {
+                log_info("forwarding %s to %s", strsignal(sig), inst->name);
+                kill(current_proc(inst)->proc.pid, sig);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Describe the state of an instance
+ *
+ * @param inst instance
+ * @param buf buffer to store the description
+ * @param size size of the buffer
+ */
+static void format_status(instance_t *inst, char *buf, size_t size)
+{
+    static const char *const state_names[] = {
+        "idle",     // INSTANCE_STATE_IDLE
+        "running",  // INSTANCE_STATE_RUNNING
+        "stopping", // INSTANCE_STATE_STOPPING
+        "waiting",  // INSTANCE_STATE_WAITING
+        "done",     // INSTANCE_STATE_DONE
+    };
+    static const char *const breaker_names[] = {
+        "closed",    // RESPAWN_BREAKER_CLOSED
+        "open",      // RESPAWN_BREAKER_OPEN
+        "half-open", // RESPAWN_BREAKER_HALF_OPEN
+    };
+    uint64_t now = event_now_ms();
+    instance_proc_t *p = current_proc(inst);
+    bool running = inst->state == INSTANCE_STATE_RUNNING || inst->state == INSTANCE_STATE_STOPPING;
+    char ready[32];
+    int len;
+
+    if (running)
+    {
+        if (p->reloading)
+        {
+            snprintf(ready, sizeof(ready), "reloading");
+        }
+        else if (p->ready)
+        {
+            snprintf(ready, sizeof(ready), "yes after %llu ms", (unsigned long long)p->ready_after_ms);
+        }
+        else
+        {
+            snprintf(ready, sizeof(ready), "no");
+        }
+
+        len = snprintf(buf, size, "%s: %s, pid: %d, uptime: %llu ms, ready: %s, respawns: %u, breaker: %s",
+                       inst->name,
+                       state_names[inst->state],
+                       p->proc.pid,
+                       (unsigned long long)(now - p->started_ms),
+                       ready,
+                       inst->respawn_cnt,
+                       breaker_names[inst->breaker]);
+
+        if (len >= 0 && (size_t)len < size && inst->svc->opt->health_probe != HEALTH_PROBE_NONE)
+        {
+            len += snprintf(buf + len, size - len, ", health failures: %d", inst->health_failures);
+        }
+
+        if (len >= 0 && (size_t)len < size && uses_resource_limits(inst->svc->opt))
+        {
+            len += snprintf(buf + len, size - len, ", rss: %llu KiB", (unsigned long long)(p->rss_bytes / 1024));
+            if (len >= 0 && (size_t)len < size && p->cpu_percent >= 0)
+            {
+                len += snprintf(buf + len, size - len, ", cpu: %d%%", p->cpu_percent);
+            }
+        }
+
+        const spawn_replica_t *replica = &inst->svc->opt->plan.replicas[inst->index];
+        if (len >= 0 && (size_t)len < size && replica->pin_cpus)
+        {
+            char cpus[128];
+
+            cpu_list_format(&replica->cpus, cpus, sizeof(cpus));
+            len += snprintf(buf + len, size - len, ", cpus: %s", cpus);
+            if (len >= 0 && (size_t)len < size && replica->numa_node >= 0)
+            {
+                len += snprintf(buf + len, size - len, ", node: %d", replica->numa_node);
+            }
+            if (len >= 0 && (size_t)len < size && inst->migration_cnt > 0)
+            {
+                len += snprintf(buf + len, size - len, ", migrations: %u", inst->migration_cnt);
+            }
+        }
+
+        if (len >= 0 && (size_t)len < size && inst->stray_cnt > 0)
+        {
+            len += snprintf(buf + len, size - len, ", strays: %llu", (unsigned long long)inst->stray_cnt);
+        }
+
+        if (len >= 0 && (size_t)len < size && p->main_pid > 0)
+        {
+            len += snprintf(buf + len, size - len, ", main pid: %d", p->main_pid);
+        }
+
+        if (len >= 0 && (size_t)len < size && p->status[0])
+        {
+            len += snprintf(buf + len, size - len, ", status: %s", p->status);
+        }
+    }
+    else if (inst->state == INSTANCE_STATE_WAITING)
+    {
+        len = snprintf(buf, size, "%s: %s, respawn in %llu ms, respawns: %u, breaker: %s",
+                       inst->name,
+                       state_names[inst->state],
+                       (unsigned long long)(inst->timer.expire_ms > now ? inst->timer.expire_ms - now : 0),
+                       inst->respawn_cnt,
+                       breaker_names[inst->breaker]);
+    }
+    else
+    {
+        len = snprintf(buf, size, "%s: %s, respawns: %u", inst->name, state_names[inst->state], inst->respawn_cnt);
+    }
+
+    if (len >= 0 && (size_t)len < size && other_proc(inst)->proc.pid >= 0)
+    {
+        snprintf(buf + len, size - len, ", %s pid: %d",
+                 inst->restarting ? "replacement" : "previous",
+                 other_proc(inst)->proc.pid);
+    }
+}
+
+/**
+ * @brief Log the state of every instance
+ *
+ */
+void supervisor_log_status(void)
+{
+    char buf[512];
+
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        service_t *svc = services[i];
+
+        for (int j = 0; j < svc->instance_cnt; j++)
+        {
+            format_status(&svc->instances[j], buf, sizeof(buf));
+            log_info("status %s", buf);
+        }
+    }
+}
+
+/**
+ * @brief Write the state of every instance, one per line
+ *
+ * @param stream output stream
+ */
+void supervisor_write_status(FILE *stream)
+{
+    char buf[512];
+
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        service_t *svc = services[i];
+
+        for (int j = 0; j < svc->instance_cnt; j++)
+        {
+            format_status(&svc->instances[j], buf, sizeof(buf));
+            fprintf(stream, "%s\n", buf);
+        }
+    }
+}
+
+/**
+ * @brief Write the probe latencies of every service with a health probe,
+ * one per line
+ *
+ * @param stream output stream
+ */
+void supervisor_write_latency(FILE *stream)
+{
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        service_t *svc = services[i];
+        const histogram_t *hist = &svc->latency;
+
+        if (svc->opt->health_probe == HEALTH_PROBE_NONE)
+        {
+            continue;
+        }
+
+        fprintf(stream, "%s: probes: %llu, failed: %llu, p50: %llu us, p99: %llu us, max: %llu us\n",
+                svc->name,
+                (unsigned long long)hist->total,
+                (unsigned long long)svc->probe_failures,
+                (unsigned long long)histogram_percentile(hist, 50),
+                (unsigned long long)histogram_percentile(hist, 99),
+                (unsigned long long)hist->max_us);
+    }
+}
+
+/**
+ * @brief Find the instance an orphan descends from by its session
+ *
+ * Targets and probe commands start their own session, which the processes
+ * they fork stay in unless they start their own. The session of an orphan
+ * is the pid of the current or last process of a slot, or of a probe
+ * command.
+ *
+ * @param sid session id of the orphan
+ * @return instance_t*
+ * @retval `inst` instance
+ * @retval `NULL` unknown session
+ */
+static instance_t *find_session_instance(pid_t sid)
+{
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        service_t *svc = services[i];
+
+        for (int j = 0; j < svc->instance_cnt; j++)
+        {
+            instance_t *inst = &svc->instances[j];
+
+            if (inst->health.proc.pid == sid)
+            {
+                return inst;
+            }
+
+            for (int k = 0; k < 2; k++)
+            {
+                if (inst->procs[k].proc.pid == sid || inst->procs[k].exit_pid == sid)
+                {
+                    return inst;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Called for an orphaned descendant reaped as subreaper
+ *
+ * The orphan is counted against the instance it descends from, shown in
+ * the status, so that services leaking processes can be found.
+ *
+ * @param pid process id of the orphan
+ * @param sid session id of the orphan, -1 if unknown
+ * @param status status from waitpid()
+ */
+void supervisor_stray_exited(pid_t pid, pid_t sid, int status)
+{
+    instance_t *inst = sid > 0 ? find_session_instance(sid) : NULL;
+    char how[32];
+
+    if (WIFEXITED(status))
+    {
+        snprintf(how, sizeof(how), "status: %d", WEXITSTATUS(status));
+    }
+    else
+    {
+        snprintf(how, sizeof(how), "signal: %d", WTERMSIG(status));
+    }
+
+    if (!inst)
+    {
+        log_debug("reaped orphan %d of session %d, %s", pid, sid, how);
+        return;
+    }
+
+    inst->stray_cnt++;
+    log_debug("reaped orphan %d of %s, %s", pid, inst->name, how);
+}
+
+/**
+ * @brief Restart the targets of a service or an instance without downtime
+ *
+ * See `instance_restart()`. Instances are restarted concurrently, each one
+ * next to its own replacement.
+ *
+ * @param name service or instance name, NULL for all instances
+ * @return int
+ * @retval `>=0` number of instances being restarted
+ * @retval `-1` no such service or instance
+ */
+int supervisor_restart(const char *name)
+{
+    bool found = false;
+    int cnt = 0;
+
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        service_t *svc = services[i];
+        bool whole = !name || strcmp(svc->name, name) == 0;
+
+        for (int j = 0; j < svc->instance_cnt; j++)
+        {
+            instance_t *inst = &svc->instances[j];
+
+            if (!whole && strcmp(inst->name, name) != 0)
+            {
+                continue;
+            }
+
+            found = true;
+            if (instance_restart(inst) == 0)
+            {
+                cnt++;
+            }
+        }
+    }
+
+    return found ? cnt : -1;
+}
+
+/**
+ * @brief Check whether the targets of a service talk to the notify socket
+ *
+ * @param opt option
+ * @return bool
+ */
+static bool uses_notify(const option_t *opt)
+{
+    return opt->notify || opt->watchdog_ms > 0;
+}
+
+/**
+ * @brief Find the process slot a notification comes from
+ *
+ * A message is accepted from a process spawned by a service with `--notify`
+ * or `--watchdog`, or from the main pid it announced.
+ *
+ * @param pid pid of the sender
+ * @return instance_proc_t*
+ * @retval `slot` process slot
+ * @retval `NULL` unknown sender
+ */
+static instance_proc_t *find_notify_proc(pid_t pid)
+{
+    proc_t *proc = proc_find(pid);
+    if (proc)
+    {
+        instance_proc_t *p = proc->data;
+
+        // probe commands are watched as well
+        return proc->on_exit == proc_exit_handler && uses_notify(p->inst->svc->opt) ? p : NULL;
+    }
+
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        service_t *svc = services[i];
+
+        for (int j = 0; j < svc->instance_cnt && uses_notify(svc->opt); j++)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                instance_proc_t *p = &svc->instances[j].procs[k];
+
+                if (p->proc.pid >= 0 && p->main_pid == pid)
+                {
+                    return p;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Handle a line of a notification message
+ *
+ * @param p process slot of the sender
+ * @param line assignment in the form of NAME=VALUE
+ */
+static void notify_line(instance_proc_t *p, const char *line)
+{
+    instance_t *inst = p->inst;
+
+    if (strcmp(line, "READY=1") == 0)
+    {
+        if (p->reloading)
+        {
+            p->reloading = false;
+            log_info("%s reloaded in %llu ms, pid: %d",
+                     inst->name,
+                     (unsigned long long)(event_now_ms() - p->reload_started_ms),
+                     p->proc.pid);
+        }
+        else if (!p->ready && !p->stopping)
+        {
+            proc_ready(p);
+        }
+    }
+    else if (strcmp(line, "WATCHDOG=1") == 0)
+    {
+        p->watchdog_ms = event_now_ms();
+    }
+    else if (strcmp(line, "WATCHDOG=trigger") == 0)
+    {
+        if (p->watchdog_timer.active)
+        {
+            event_timer_stop(&p->watchdog_timer);
+            watchdog_expired(p);
+        }
+    }
+    else if (strcmp(line, "RELOADING=1") == 0)
+    {
+        p->reloading = true;
+        p->reload_started_ms = event_now_ms();
+        log_info("%s is reloading, pid: %d", inst->name, p->proc.pid);
+    }
+    else if (strcmp(line, "STOPPING=1") == 0)
+    {
+        p->ready = false;
+        log_info("%s is stopping, pid: %d", inst->name, p->proc.pid);
+    }
+    else if (strncmp(line, "STATUS=", strlen("STATUS=")) == 0)
+    {
+        snprintf(p->status, sizeof(p->status), "%s", line + strlen("STATUS="));
+    }
+    else if (strncmp(line, "MAINPID=", strlen("MAINPID=")) == 0)
+    {
+        char *endptr = NULL;
+        long pid = strtol(line + strlen("MAINPID="), &endptr, 10);
+
+        if (pid > 0 && pid <= INT32_MAX && *endptr == '\0' && pid != p->main_pid)
+        {
+            p->main_pid = pid;
+            log_info("%s main pid is %d", inst->name, p->main_pid);
+        }
+    }
+}
+
+/**
+ * @brief Handle a notification message sent to NOTIFY_SOCKET
+ *
+ * Understands the sd_notify() assignments READY=1, RELOADING=1,
+ * STOPPING=1, STATUS=, MAINPID= and WATCHDOG=, one per line; others are
+ * ignored. The main pid is recorded and accepted as a sender, the spawned
+ * process stays the one supervised.
+ *
+ * @param pid pid of the sender, from its credentials
+ * @param msg message, null-terminated, modified
+ */
+void supervisor_notify(pid_t pid, char *msg)
+{
+    instance_proc_t *p = find_notify_proc(pid);
+    if (!p)
+    {
+        log_debug("ignored notification from unknown pid %d", pid);
+        return;
+    }
+
+    char *saveptr = NULL;
+
+    for (char *line = strtok_r(msg, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr))
+    {
+        notify_line(p, line);
+    }
+}
+
+/**
+ * @brief Check whether all instances are stopped for good
+ *
+ * @return bool
+ */
+bool supervisor_finished(void)
+{
+    return live_cnt == 0 && running_cnt == 0 && health_check_proc_cnt() == 0;
+}
+
+/**
+ * @brief Get the exit status of the supervisor
+ *
+ * @return int EXIT_SUCCESS or EXIT_FAILURE
+ */
+int supervisor_exit_code(void)
+{
+    return exit_code;
+}
+
+/**
+ * @brief Release all services
+ *
+ */
+void supervisor_cleanup(void)
+{
+    event_timer_stop(&rebalance_timer);
+
+    for (size_t i = 0; i < service_cnt; i++)
+    {
+        service_t *svc = services[i];
+
+        for (int j = 0; j < svc->instance_cnt; j++)
+        {
+            instance_t *inst = &svc->instances[j];
+
+            event_timer_stop(&inst->timer);
+
+            health_stop(inst);
+            proc_unwatch(&inst->health.proc);
+            event_timer_stop(&inst->resource_timer);
+
+            for (int k = 0; k < 2; k++)
+            {
+                event_timer_stop(&inst->procs[k].timer);
+                event_timer_stop(&inst->procs[k].watchdog_timer);
+                close_ready_pipe(&inst->procs[k]);
+                resource_sampler_close(&inst->procs[k].sampler);
+                close_cgroup_event(&inst->procs[k]);
+                proc_unwatch(&inst->procs[k].proc);
+            }
+
+            free(inst->name);
+            free(inst->respawn_ring);
+            free(inst->rss_trend.samples);
+        }
+
+        free(svc->instances);
+        free(svc);
+    }
+
+    free(services);
+    services = NULL;
+    service_cnt = 0;
+    live_cnt = 0;
+    running_cnt = 0;
+}